@@ -0,0 +1,107 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// minimal benchmark harness shared by the bench/ programs. results are
+// printed as a table on stderr and as JSON on stdout, so they can be saved
+// and compared between releases.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+struct Result {
+    std::string name;
+    uint64_t iterations = 0;
+    double ns_per_op = 0;
+    // extra throughput figures, e.g. {"MB/s", 120.5}
+    std::vector<std::pair<std::string, double>> metrics;
+};
+
+// keeps the compiler from optimizing away a value that is never read
+template <typename T>
+inline void keep(T &&value){
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+inline double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// calls op() in growing batches until a batch takes at least min_seconds
+template <typename F>
+Result measure(const std::string &name, F &&op, double min_seconds = 0.2){
+    Result r;
+    r.name = name;
+    for(uint64_t batch = 1; ; batch *= 2){
+        auto start = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < batch; i++){
+            op();
+        }
+        double secs = seconds_since(start);
+        if(secs >= min_seconds || batch >= (1ull << 40)){
+            r.iterations = batch;
+            r.ns_per_op = secs * 1e9 / batch;
+            return r;
+        }
+    }
+}
+
+// same as measure, but setup() builds the input of every op in a batch
+// before the clock starts, for ops that consume their input (eval does)
+template <typename Setup, typename F>
+Result measure_with_setup(const std::string &name, Setup &&setup, F &&op,
+    double min_seconds = 0.2){
+    Result r;
+    r.name = name;
+    for(uint64_t batch = 1; ; batch *= 2){
+        std::vector<decltype(setup())> inputs;
+        inputs.reserve(batch);
+        for(uint64_t i = 0; i < batch; i++){
+            inputs.push_back(setup());
+        }
+        auto start = std::chrono::steady_clock::now();
+        for(auto &input : inputs){
+            op(input);
+        }
+        double secs = seconds_since(start);
+        if(secs >= min_seconds || batch >= (1ull << 24)){
+            r.iterations = batch;
+            r.ns_per_op = secs * 1e9 / batch;
+            return r;
+        }
+    }
+}
+
+inline void print_table(FILE *out, const std::vector<Result> &results){
+    fprintf(out, "%-40s %12s %14s\n", "benchmark", "iterations", "ns/op");
+    for(const Result &r : results){
+        fprintf(out, "%-40s %12lu %14.1f", r.name.c_str(), r.iterations, r.ns_per_op);
+        for(auto &[unit, value] : r.metrics){
+            fprintf(out, "  %.1f %s", value, unit.c_str());
+        }
+        fprintf(out, "\n");
+    }
+}
+
+inline void write_json(FILE *out, const std::string &suite, const std::vector<Result> &results){
+    fprintf(out, "{\n  \"suite\": \"%s\",\n  \"results\": [\n", suite.c_str());
+    for(size_t i = 0; i < results.size(); i++){
+        const Result &r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %lu, \"ns_per_op\": %.3f",
+            r.name.c_str(), r.iterations, r.ns_per_op);
+        for(auto &[unit, value] : r.metrics){
+            fprintf(out, ", \"%s\": %.3f", unit.c_str(), value);
+        }
+        fprintf(out, "}%s\n", (i + 1 < results.size()) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+}
+
+#endif
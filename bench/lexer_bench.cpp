@@ -0,0 +1,108 @@
+// lexer throughput: owning tokens (next_token) vs views over a mapped file
+// (next_token_view), the streaming lexer and tokenize_parallel scaling from
+// 1 to N threads. usage: lexer_bench.out [script] [megabytes]
+#include "../lexer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace {
+
+const char *SNIPPET = R"(let five = 5;
+let ten = 10;
+let add = fn(x, y){
+    x + y;
+};
+let result = add(five, ten);
+if (five < ten) {
+    return true;
+} else {
+    return false;
+}
+10 == 10; 10 != 9; !-five * ten / 2;
+)";
+
+void generate(const std::string &path, size_t megabytes){
+    std::ofstream out(path);
+    size_t target = megabytes * 1024 * 1024;
+    std::string snippet(SNIPPET);
+    for(size_t written = 0; written < target; written += snippet.size()){
+        out << snippet;
+    }
+}
+
+template <typename F>
+double run(const char *name, std::string_view src, F &&lex_all){
+    auto start = std::chrono::steady_clock::now();
+    size_t count = lex_all(src);
+    auto end = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(end - start).count();
+    double mbs = (src.size() / (1024.0 * 1024.0)) / secs;
+    printf("%-24s %10zu tokens %8.3f s %10.1f MB/s\n", name, count, secs, mbs);
+    return mbs;
+}
+
+}
+
+int main(int argc, char **argv){
+    std::string path = argc > 1 ? argv[1] : "/tmp/monkey_lexer_bench.monkey";
+    size_t megabytes = argc > 2 ? std::atoi(argv[2]) : 16;
+    if(argc <= 1){
+        generate(path, megabytes);
+    }
+
+    lexer::MappedFile file(path);
+    if(!file.is_open()){
+        printf("could not open %s\n", path.c_str());
+        return 1;
+    }
+
+    double before = run("next_token", file.view(), [](std::string_view src){
+        lexer::Lexer l(src);
+        size_t count = 0;
+        for(auto tok = l.next_token(); tok.type != lexer::TokenType::ENDOF;
+            tok = l.next_token()){
+            count++;
+        }
+        return count;
+    });
+    double after = run("next_token_view (mmap)", file.view(), [](std::string_view src){
+        lexer::Lexer l(src);
+        size_t count = 0;
+        for(auto tok = l.next_token_view(); tok.type != lexer::TokenType::ENDOF;
+            tok = l.next_token_view()){
+            count++;
+        }
+        return count;
+    });
+    printf("speedup %.2fx\n", after / before);
+
+    run("StreamLexer (64K window)", file.view(), [&path](std::string_view){
+        std::ifstream in(path);
+        lexer::StreamLexer l(in);
+        size_t count = 0;
+        for(auto tok = l.next_token(); tok.type != lexer::TokenType::ENDOF;
+            tok = l.next_token()){
+            count++;
+        }
+        return count;
+    });
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    double serial = 0;
+    for(unsigned threads = 1; threads <= cores * 2; threads *= 2){
+        std::string name = "tokenize_parallel x" + std::to_string(threads);
+        double mbs = run(name.c_str(), file.view(), [threads](std::string_view src){
+            return lexer::tokenize_parallel(src, threads).size();
+        });
+        if(threads == 1){
+            serial = mbs;
+        }
+        printf("%-24s scaling %.2fx (%u cores)\n", "", mbs / serial, cores);
+    }
+    return 0;
+}
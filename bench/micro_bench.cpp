@@ -0,0 +1,408 @@
+// component micro-benchmarks: lexer, parser, environment, object
+// allocation, cycle collection and eval on a few canonical programs.
+// usage: micro_bench.out > results.json   (table goes to stderr)
+#include "bench.h"
+#include "../cache.h"
+#include "../evaluator.h"
+#include "../flat.h"
+#include "../gc.h"
+#include "../opt.h"
+#include "../reparse.h"
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <functional>
+#include <memory>
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *SNIPPET = R"(let five = 5;
+let ten = 10;
+let add = fn(x, y){
+    x + y;
+};
+let result = add(five, ten);
+if (five < ten) {
+    return true;
+} else {
+    return false;
+}
+10 == 10; 10 != 9; !-five * ten / 2;
+)";
+
+std::string repeat(const std::string &s, size_t times){
+    std::string out;
+    out.reserve(s.size() * times);
+    for(size_t i = 0; i < times; i++){
+        out += s;
+    }
+    return out;
+}
+
+size_t count_nodes(const parser::Node *node){
+    if(node == nullptr){
+        return 0;
+    }
+    size_t n = 1;
+    if(auto p = dynamic_cast<const parser::Program*>(node)){
+        for(auto &s : p->statements) n += count_nodes(s.get());
+    }else if(auto p = dynamic_cast<const parser::BlockStatement*>(node)){
+        for(auto &s : p->statements) n += count_nodes(s.get());
+    }else if(auto p = dynamic_cast<const parser::LetStatement*>(node)){
+        n += count_nodes(p->name.get()) + count_nodes(p->value.get());
+    }else if(auto p = dynamic_cast<const parser::ReturnStatement*>(node)){
+        n += count_nodes(p->return_value.get());
+    }else if(auto p = dynamic_cast<const parser::ExpressionStatement*>(node)){
+        n += count_nodes(p->expr.get());
+    }else if(auto p = dynamic_cast<const parser::PrefixExpression*>(node)){
+        n += count_nodes(p->right.get());
+    }else if(auto p = dynamic_cast<const parser::InfixExpression*>(node)){
+        n += count_nodes(p->left.get()) + count_nodes(p->right.get());
+    }else if(auto p = dynamic_cast<const parser::IfExpression*>(node)){
+        n += count_nodes(p->cond.get()) + count_nodes(p->consequence.get()) +
+            count_nodes(p->alternative.get());
+    }else if(auto p = dynamic_cast<const parser::FunctionLiteral*>(node)){
+        for(auto &param : p->parameters) n += count_nodes(param.get());
+        n += count_nodes(p->body.get());
+    }else if(auto p = dynamic_cast<const parser::CallExpression*>(node)){
+        n += count_nodes(p->function.get());
+        for(auto &arg : p->arguments) n += count_nodes(arg.get());
+    }
+    return n;
+}
+
+// straight-line code big enough that the AST does not stay in cache
+const char *LARGE_BLOCK = R"(let a = (5 + 10 * 2 + 15 / 3) * 2 + -10;
+let b = if (a > 40) { a - 40 } else { 40 - a };
+let c = !(a == b) == true;
+let d = (a + b) * (a - b) / 7 + (b * 3 - a / 2);
+)";
+
+// a generated script: many helper functions, of which only a few are called
+std::string helpers_script(size_t helpers, size_t called){
+    std::string out;
+    for(size_t i = 0; i < helpers; i++){
+        out += fmt::format("let helper{} = fn(a, b) {{ let c = a * {} + b; "
+            "let d = if (c > 100) {{ c - 100 }} else {{ 100 - c }}; "
+            "return (c + d) * 2 - a / 3; }};\n", i, i);
+    }
+    for(size_t i = 0; i < called; i++){
+        out += fmt::format("helper{}({}, 2);\n", i * (helpers / called), i);
+    }
+    return out;
+}
+
+// peak native stack used by fn: it runs on a thread whose stack is filled
+// with a pattern first, and the bytes still holding it were never touched
+size_t stack_used(const std::function<void()> &fn){
+    constexpr size_t SIZE = 64 << 20;
+    constexpr unsigned char PATTERN = 0xa5;
+    auto stack = static_cast<unsigned char*>(aligned_alloc(4096, SIZE));
+    memset(stack, PATTERN, SIZE);
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstack(&attr, stack, SIZE);
+    pthread_t thread;
+    pthread_create(&thread, &attr, [](void *arg) -> void* {
+        (*static_cast<const std::function<void()>*>(arg))();
+        return nullptr;
+    }, const_cast<std::function<void()>*>(&fn));
+    pthread_join(thread, nullptr);
+    pthread_attr_destroy(&attr);
+    size_t untouched = 0;
+    while(untouched < SIZE && stack[untouched] == PATTERN){
+        untouched++;
+    }
+    free(stack);
+    return SIZE - untouched;
+}
+
+struct Program {
+    const char *name;
+    const char *source;
+};
+
+const std::vector<Program> PROGRAMS = {
+    {"arithmetic", "(5 + 10 * 2 + 15 / 3) * 2 + -10 == 50"},
+    {"let_chain", "let a = 5; let b = a * 2; let c = a + b * 3; let d = c - a; d"},
+    {"conditionals", "if (1 < 2) { if (3 > 4) { 1 } else { 2 } } else { 3 }"},
+    {"function_calls", "let add = fn(x, y) { x + y }; add(add(1, 2), add(3, 4))"},
+    {"repeated_calls", "let f = fn(x) { let y = x * 2; y + 1 }; "
+        "f(1) + f(2) + f(3) + f(4) + f(5) + f(6) + f(7) + f(8)"},
+};
+
+}
+
+int main(){
+    std::vector<bench::Result> results;
+
+    std::string source = repeat(SNIPPET, 256);
+    double mb = source.size() / (1024.0 * 1024.0);
+    {
+        auto r = bench::measure("lexer/next_token", [&](){
+            lexer::Lexer l(source);
+            for(auto tok = l.next_token(); tok.type != lexer::TokenType::ENDOF;
+                tok = l.next_token()){
+                bench::keep(tok);
+            }
+        });
+        r.metrics.push_back({"mb_per_sec", mb / (r.ns_per_op * 1e-9)});
+        results.push_back(r);
+    }
+    {
+        auto r = bench::measure("lexer/next_token_view", [&](){
+            lexer::Lexer l(source);
+            for(auto tok = l.next_token_view(); tok.type != lexer::TokenType::ENDOF;
+                tok = l.next_token_view()){
+                bench::keep(tok);
+            }
+        });
+        r.metrics.push_back({"mb_per_sec", mb / (r.ns_per_op * 1e-9)});
+        results.push_back(r);
+    }
+    {
+        lexer::Lexer l(source);
+        auto p = parser::Parser(l);
+        size_t nodes = count_nodes(p.parse_program().get());
+        auto r = bench::measure("parser/parse_program", [&](){
+            lexer::Lexer l(source);
+            auto p = parser::Parser(l);
+            auto program = p.parse_program();
+            bench::keep(program);
+        });
+        r.metrics.push_back({"nodes_per_sec", nodes / (r.ns_per_op * 1e-9)});
+        results.push_back(r);
+    }
+    // the large program parsed into an arena and onto the heap. parse_*
+    // includes dropping the program, teardown_* is the drop alone
+    for(bool use_arena : {true, false}){
+        std::string suffix = use_arena ? "arena" : "heap";
+        auto parse = [&](){
+            lexer::Lexer l(source);
+            auto p = parser::Parser(l);
+            p.heap_nodes = !use_arena;
+            return p.parse_program();
+        };
+        auto r = bench::measure("parser/parse_" + suffix, [&](){
+            auto program = parse();
+            bench::keep(program);
+        });
+        // arena blocks the tree takes, nodes and the text of their spans
+        if(use_arena){
+            auto program = parse();
+            r.metrics.push_back({"ast_kb", program->arena->blocks.size() *
+                parser::AstArena::BLOCK_SIZE / 1024.0});
+        }
+        results.push_back(r);
+        results.push_back(bench::measure_with_setup("parser/teardown_" + suffix, parse,
+            [&](parser::NodePtr<parser::Program> &program){
+                program.reset();
+            }));
+    }
+    // slots of a call's frame, addressed the way the resolver does: a
+    // local, and a global one frame out
+    {
+        auto globals = object::new_environment();
+        uint32_t counter = lexer::intern("counter");
+        globals->set(counter, object::Value::from_int(0));
+        auto env = object::new_enclosed_environment(globals, 4);
+        int64_t i = 0;
+        results.push_back(bench::measure("environment/set", [&](){
+            env->set(1, object::Value::from_int(i++));
+        }));
+        results.push_back(bench::measure("environment/get", [&](){
+            auto [val, ok] = env->get(0, 1);
+            bench::keep(val);
+        }));
+        results.push_back(bench::measure("environment/get_outer", [&](){
+            auto [val, ok] = env->get(1, counter);
+            bench::keep(val);
+        }));
+    }
+    // integers and booleans are immediate values; an error is the
+    // cheapest object that still goes to the heap
+    {
+        int64_t i = 0;
+        results.push_back(bench::measure("object/integer_value", [&](){
+            auto obj = object::Value::from_int(i++);
+            bench::keep(obj);
+        }));
+        results.push_back(bench::measure("object/boolean_value", [&](){
+            auto obj = object::Value::from_bool(true);
+            bench::keep(obj);
+        }));
+        results.push_back(bench::measure("object/error_alloc", [&](){
+            auto obj = eval::new_error("boom");
+            bench::keep(obj);
+        }));
+    }
+    // every call of f leaves its scope and g pointing at each other, so
+    // only the collector can free them
+    {
+        std::string input = "let f = fn() { let g = fn() { 1 }; g() };" + repeat(" f();", 64);
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        gc::heap.stats = gc::Stats();
+        auto r = bench::measure("gc/closure_cycles", [&](){
+            auto env = object::new_environment();
+            auto result = eval::eval(*program, env);
+            bench::keep(result);
+        });
+        r.metrics.push_back({"max_pause_us", gc::heap.stats.max_pause_ns / 1e3});
+        results.push_back(r);
+    }
+    // each program as parsed (-O0) and after opt::optimize (-O1). eval only
+    // reads the tree, so every program is parsed once and run repeatedly
+    for(const Program &prog : PROGRAMS){
+        std::string input = prog.source;
+        for(int level : {0, 1}){
+            std::string name = std::string("eval/") + prog.name + (level ? "/O1" : "");
+            lexer::Lexer l(input);
+            auto p = parser::Parser(l);
+            auto program = p.parse_program();
+            opt::optimize(*program, level);
+            results.push_back(bench::measure(name, [&](){
+                auto env = object::new_environment();
+                auto result = eval::eval(*program, env);
+                bench::keep(result);
+            }));
+        }
+    }
+
+    // the same large program through the tree evaluator and the flat one
+    {
+        std::string input = repeat(LARGE_BLOCK, 2048);
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        results.push_back(bench::measure("eval/tree_large", [&](){
+            auto env = object::new_environment();
+            auto result = eval::eval(*program, env);
+            bench::keep(result);
+        }));
+
+        results.push_back(bench::measure("flat/flatten_large", [&](){
+            auto ast = flat::flatten(*program);
+            bench::keep(ast);
+        }));
+        auto ast = flat::flatten(*program);
+        results.push_back(bench::measure("eval/flat_large", [&](){
+            auto env = object::new_environment();
+            auto result = flat::eval(ast, ast->root, env);
+            bench::keep(result);
+        }));
+    }
+
+    // generated worst cases for the expression parser: deep parentheses,
+    // prefix operators and calls, and one very long chain. stack_kb is the
+    // native stack the parse needed, which should not grow with the input
+    {
+        std::string chain = "a";
+        for(int i = 0; i < 100000; i++){
+            chain += " + a";
+        }
+        auto nested = [](const std::string &open, const std::string &close, size_t n){
+            std::string out;
+            for(size_t i = 0; i < n; i++) out += open;
+            out += "1";
+            for(size_t i = 0; i < n; i++) out += close;
+            return out;
+        };
+        std::vector<std::pair<std::string, std::string>> inputs = {
+            {"parser/parens_100", nested("(", ")", 100)},
+            {"parser/parens_4000", nested("(", ")", 4000)},
+            {"parser/prefix_4000", nested("-", "", 4000)},
+            {"parser/calls_4000", nested("f(x, ", ")", 4000)},
+            {"parser/chain_100000", chain},
+        };
+        for(auto &[name, input] : inputs){
+            auto parse = [&](){
+                lexer::Lexer l(input);
+                auto p = parser::Parser(l);
+                // the chain is taller than the default limit
+                p.max_nesting = input.size();
+                auto program = p.parse_program();
+                bench::keep(program);
+            };
+            auto r = bench::measure(name, parse);
+            r.metrics.push_back({"stack_kb", stack_used(parse) / 1024.0});
+            results.push_back(r);
+        }
+    }
+
+    // 2000 helpers with 20 called: parse everything up front, or only the
+    // bodies that run. parse+eval is the whole script run
+    {
+        std::string input = helpers_script(2000, 20);
+        for(bool lazy : {false, true}){
+            std::string mode = lazy ? "lazy" : "eager";
+            auto parse = [&](){
+                lexer::Lexer l(input);
+                auto p = parser::Parser(l);
+                p.lazy_bodies = lazy;
+                return p.parse_program();
+            };
+            results.push_back(bench::measure("parser/helpers_" + mode, [&](){
+                auto program = parse();
+                bench::keep(program);
+            }));
+            results.push_back(bench::measure("eval/helpers_" + mode, [&](){
+                auto program = parse();
+                auto env = object::new_environment();
+                auto result = eval::eval(*program, env);
+                bench::keep(result);
+            }));
+        }
+    }
+
+    // one literal in the middle of the large program changes: parse the
+    // new text from scratch, or update the previous parse. the edit flips
+    // between two values so the document never drifts
+    {
+        std::string input = repeat(LARGE_BLOCK, 2048);
+        size_t at = input.find("15 / 3", input.size() / 2);
+        results.push_back(bench::measure("reparse/full_large", [&](){
+            auto doc = reparse::parse(input);
+            bench::keep(doc);
+        }));
+        auto doc = reparse::parse(input);
+        bool flip = false;
+        results.push_back(bench::measure("reparse/edit_large", [&](){
+            flip = !flip;
+            auto stats = reparse::apply(doc, {at, 2, flip ? "16" : "15"});
+            bench::keep(stats);
+        }));
+    }
+
+    // startup of the large program: lex, parse and optimize against
+    // rebuilding the same tree from its cache bytes
+    {
+        std::string input = repeat(LARGE_BLOCK, 2048);
+        auto parse = [&](){
+            lexer::Lexer l(input);
+            auto p = parser::Parser(l);
+            auto program = p.parse_program();
+            opt::optimize(*program, 1);
+            return program;
+        };
+        std::string data = cache::serialize(*parse(), input, 1);
+        results.push_back(bench::measure("cache/parse_large", [&](){
+            auto program = parse();
+            bench::keep(program);
+        }));
+        auto r = bench::measure("cache/load_large", [&](){
+            auto program = cache::deserialize(data, input, 1);
+            bench::keep(program);
+        });
+        r.metrics.push_back({"cache_bytes", double(data.size())});
+        results.push_back(r);
+    }
+
+    bench::print_table(stderr, results);
+    bench::write_json(stdout, "micro", results);
+    return 0;
+}
@@ -0,0 +1,295 @@
+// end-to-end benchmark over the programs in bench/programs (plus a large
+// generated expression file). every program runs in a forked child so its
+// peak RSS is its own, and a crash is reported instead of ending the run.
+// the result each program must give is listed in expected.txt next to it;
+// a run whose result differs, or a crash, fails the bench (exit status 1)
+// and nothing is saved.
+// usage: program_bench.out [--runs N] [--baseline file.json] [--save file.json]
+//        [program.monkey ...]
+#include "bench.h"
+#include "../evaluator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> alloc_count = 0;
+std::atomic<uint64_t> alloc_bytes = 0;
+
+}
+
+// count every allocation made through the global operator new
+void *operator new(size_t size){
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if(void *p = malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+namespace {
+
+struct Program {
+    std::string name;
+    std::string source;
+    // what inspect() of the result must give
+    std::string expected;
+};
+
+// expected.txt in the directory of a program has a `<name> <result>` line
+// per program. expected stays empty when the program is not listed
+Program load_program(const std::filesystem::path &path){
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    Program prog{path.stem(), ss.str(), ""};
+    std::ifstream expected(path.parent_path() / "expected.txt");
+    std::string line;
+    while(std::getline(expected, line)){
+        size_t space = line.find(' ');
+        if(space != std::string::npos && line.substr(0, space) == prog.name){
+            prog.expected = line.substr(space + 1);
+            break;
+        }
+    }
+    return prog;
+}
+
+// what a child sends back to the parent through a pipe
+struct Report {
+    bool ok;
+    double mean_ns;
+    double min_ns;
+    double allocs_per_run;
+    double bytes_per_run;
+    long peak_rss_kb;
+    // the result of the last run, or what went wrong
+    char result[64];
+};
+
+// identifiers are letters only, so number the variables in base 26
+std::string var_name(size_t i){
+    std::string name = "v";
+    do {
+        name += char('a' + i % 26);
+        i /= 26;
+    } while(i > 0);
+    return name;
+}
+
+std::string generated_expressions(size_t lines){
+    std::string src;
+    for(size_t i = 0; i < lines; i++){
+        src += "let " + var_name(i) + " = (" + std::to_string(i) +
+            " + 4 * 7 - 12 / 3) * 2 == " + std::to_string(i * 2 + 48) + ";\n";
+    }
+    src += var_name(lines - 1) + ";\n";
+    return src;
+}
+
+Report run_program(const Program &prog, int runs){
+    Report rep = {};
+    rep.min_ns = 1e300;
+    double total_ns = 0;
+    uint64_t count_before = alloc_count, bytes_before = alloc_bytes;
+    std::string result;
+    for(int i = 0; i < runs; i++){
+        auto start = std::chrono::steady_clock::now();
+        auto evaluated = eval::test_eval(prog.source);
+        double ns = bench::seconds_since(start) * 1e9;
+        total_ns += ns;
+        rep.min_ns = std::min(rep.min_ns, ns);
+        result = evaluated ? evaluated.inspect() : "nullptr";
+        if(result != prog.expected){
+            snprintf(rep.result, sizeof(rep.result), "%s", result.c_str());
+            return rep;
+        }
+    }
+    rep.ok = true;
+    rep.mean_ns = total_ns / runs;
+    rep.allocs_per_run = double(alloc_count - count_before) / runs;
+    rep.bytes_per_run = double(alloc_bytes - bytes_before) / runs;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    rep.peak_rss_kb = usage.ru_maxrss;
+    snprintf(rep.result, sizeof(rep.result), "%s", result.c_str());
+    return rep;
+}
+
+Report run_in_child(const Program &prog, int runs){
+    int fds[2];
+    if(pipe(fds) != 0){
+        return Report{};
+    }
+    pid_t pid = fork();
+    if(pid == 0){
+        close(fds[0]);
+        Report rep = run_program(prog, runs);
+        ssize_t written = write(fds[1], &rep, sizeof(rep));
+        _exit(written == sizeof(rep) && rep.ok ? 0 : 1);
+    }
+    close(fds[1]);
+    Report rep = {};
+    ssize_t got = read(fds[0], &rep, sizeof(rep));
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if(got != sizeof(rep)){
+        rep = Report{};
+        snprintf(rep.result, sizeof(rep.result), "crashed (%s)",
+            WIFSIGNALED(status) ? strsignal(WTERMSIG(status)) : "no report");
+    }
+    rep.ok = rep.ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return rep;
+}
+
+// reads back a file written by bench::write_json, one result per line
+std::vector<bench::Result> read_baseline(const std::string &path){
+    std::vector<bench::Result> results;
+    std::ifstream in(path);
+    std::string line;
+    while(std::getline(in, line)){
+        size_t name_at = line.find("{\"name\": \"");
+        if(name_at == std::string::npos){
+            continue;
+        }
+        bench::Result r;
+        size_t begin = name_at + 10;
+        r.name = line.substr(begin, line.find('"', begin) - begin);
+        for(size_t at = line.find("\", \""); at != std::string::npos;
+            at = line.find(", \"", at + 1)){
+            size_t key_begin = line.find('"', at + 1) + 1;
+            size_t key_end = line.find('"', key_begin);
+            std::string key = line.substr(key_begin, key_end - key_begin);
+            double value = strtod(line.c_str() + key_end + 2, nullptr);
+            if(key == "iterations") r.iterations = value;
+            else if(key == "ns_per_op") r.ns_per_op = value;
+            else r.metrics.push_back({key, value});
+        }
+        results.push_back(r);
+    }
+    return results;
+}
+
+double metric(const bench::Result &r, const std::string &key){
+    for(auto &[name, value] : r.metrics){
+        if(name == key) return value;
+    }
+    return 0;
+}
+
+std::string percent(double now, double before){
+    if(before <= 0){
+        return "";
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%+.1f%%", (now - before) * 100.0 / before);
+    return buf;
+}
+
+}
+
+int main(int argc, char **argv){
+    int runs = 5;
+    std::string baseline_path = "bench/baseline.json";
+    std::string save_path;
+    std::vector<Program> programs;
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if(arg == "--runs" && i + 1 < argc){
+            runs = std::max(1, atoi(argv[++i]));
+        }else if(arg == "--baseline" && i + 1 < argc){
+            baseline_path = argv[++i];
+        }else if(arg == "--save" && i + 1 < argc){
+            save_path = argv[++i];
+        }else{
+            programs.push_back(load_program(arg));
+        }
+    }
+    if(programs.empty()){
+        std::vector<std::filesystem::path> files;
+        for(auto &entry : std::filesystem::directory_iterator("bench/programs")){
+            if(entry.path().extension() == ".monkey"){
+                files.push_back(entry.path());
+            }
+        }
+        std::sort(files.begin(), files.end());
+        for(auto &path : files){
+            programs.push_back(load_program(path));
+        }
+        programs.push_back({"generated_expressions", generated_expressions(4000), "true"});
+    }
+
+    std::vector<bench::Result> baseline = read_baseline(baseline_path);
+    std::vector<bench::Result> results;
+    int failed = 0;
+    fprintf(stderr, "%-22s %-24s %11s %9s %10s %12s %9s\n", "program", "result",
+        "mean ms", "vs base", "peak KB", "allocs/run", "vs base");
+    for(const Program &prog : programs){
+        Report rep = run_in_child(prog, runs);
+        if(!rep.ok){
+            failed++;
+            fprintf(stderr, "%-22s FAILED: expected %s, got %s\n", prog.name.c_str(),
+                prog.expected.empty() ? "an entry in expected.txt" : prog.expected.c_str(),
+                rep.result);
+            continue;
+        }
+        bench::Result r;
+        r.name = prog.name;
+        r.iterations = runs;
+        r.ns_per_op = rep.mean_ns;
+        r.metrics = {
+            {"min_ns", rep.min_ns},
+            {"peak_rss_kb", double(rep.peak_rss_kb)},
+            {"allocs_per_run", rep.allocs_per_run},
+            {"bytes_per_run", rep.bytes_per_run},
+        };
+        results.push_back(r);
+
+        std::string vs_time, vs_allocs;
+        for(const bench::Result &base : baseline){
+            if(base.name == r.name){
+                vs_time = percent(r.ns_per_op, base.ns_per_op);
+                vs_allocs = percent(rep.allocs_per_run, metric(base, "allocs_per_run"));
+            }
+        }
+        fprintf(stderr, "%-22s %-24.24s %11.3f %9s %10ld %12.0f %9s\n", r.name.c_str(),
+            rep.result, r.ns_per_op / 1e6, vs_time.c_str(), rep.peak_rss_kb,
+            rep.allocs_per_run, vs_allocs.c_str());
+    }
+
+    if(failed > 0){
+        fprintf(stderr, "%d of %zu programs failed, no results written\n", failed,
+            programs.size());
+        return 1;
+    }
+    bench::write_json(stdout, "programs", results);
+    if(!save_path.empty()){
+        FILE *out = fopen(save_path.c_str(), "w");
+        if(out != nullptr){
+            bench::write_json(out, "programs", results);
+            fclose(out);
+        }
+    }
+    return 0;
+}
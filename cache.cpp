@@ -0,0 +1,592 @@
+#include "cache.h"
+#include "evaluator.h"
+#include "opt.h"
+#include "resolver.h"
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+#include <unordered_map>
+#include <unistd.h>
+#include <vector>
+
+namespace cache {
+
+namespace {
+
+constexpr char MAGIC[8] = {'M', 'O', 'N', 'K', 'E', 'Y', 'C', '\0'};
+
+enum Tag : uint8_t {
+    NONE,
+    LET,
+    RETURN,
+    EXPRESSION,
+    BLOCK,
+    IDENTIFIER,
+    INTEGER,
+    BOOLEAN,
+    PREFIX,
+    INFIX,
+    IF,
+    FUNCTION,
+    CALL,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t opt_level;
+    uint64_t source_hash;
+    uint64_t source_size;
+};
+
+using StatementList = std::vector<parser::NodePtr<parser::Statement>>;
+
+struct Writer {
+    std::string out;
+    // process symbol id -> index in the file's symbol section
+    std::unordered_map<uint32_t, uint32_t> local;
+    std::vector<uint32_t> symbols;
+    // cleared by a lazily skipped function body that does not parse
+    bool ok = true;
+
+    // what is left to write, last first. a tree can be nested far deeper
+    // than the native stack allows (see Parser), so the walk keeps its own
+    // stack. an entry is a node, or the length of the list pushed under it
+    struct Pending {
+        const parser::Node *node;
+        int64_t count = -1;
+    };
+    std::vector<Pending> pending;
+
+    template <typename T>
+    void put(T val){
+        out.append(reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+
+    void sym(uint32_t s){
+        auto [it, added] = local.emplace(s, symbols.size());
+        if(added){
+            symbols.push_back(s);
+        }
+        put<uint32_t>(it->second);
+    }
+
+    template <typename T>
+    void list(const std::vector<parser::NodePtr<T>> &items){
+        for(size_t i = items.size(); i-- > 0;){
+            pending.push_back({items[i].get()});
+        }
+        pending.push_back({nullptr, int64_t(items.size())});
+    }
+
+    void statements(const StatementList &list){
+        this->list(list);
+        while(!pending.empty()){
+            Pending next = pending.back();
+            pending.pop_back();
+            if(next.count >= 0){
+                put<uint32_t>(next.count);
+            }else{
+                node(next.node);
+            }
+        }
+    }
+
+    // writes the kind and fields of node and queues its children
+    void node(const parser::Node *node){
+        if(node == nullptr){
+            put<uint8_t>(NONE);
+        }else if(auto p = dynamic_cast<const parser::LetStatement*>(node)){
+            put<uint8_t>(LET);
+            sym(p->name->sym);
+            pending.push_back({p->value.get()});
+        }else if(auto p = dynamic_cast<const parser::ReturnStatement*>(node)){
+            put<uint8_t>(RETURN);
+            pending.push_back({p->return_value.get()});
+        }else if(auto p = dynamic_cast<const parser::ExpressionStatement*>(node)){
+            put<uint8_t>(EXPRESSION);
+            pending.push_back({p->expr.get()});
+        }else if(auto p = dynamic_cast<const parser::BlockStatement*>(node)){
+            put<uint8_t>(BLOCK);
+            list(p->statements);
+        }else if(auto p = dynamic_cast<const parser::Identifier*>(node)){
+            put<uint8_t>(IDENTIFIER);
+            sym(p->sym);
+        }else if(auto p = dynamic_cast<const parser::IntegerLiteral*>(node)){
+            put<uint8_t>(INTEGER);
+            put<int64_t>(p->val);
+        }else if(auto p = dynamic_cast<const parser::Boolean*>(node)){
+            put<uint8_t>(BOOLEAN);
+            put<uint8_t>(p->val);
+        }else if(auto p = dynamic_cast<const parser::PrefixExpression*>(node)){
+            put<uint8_t>(PREFIX);
+            put<uint8_t>(p->op);
+            pending.push_back({p->right.get()});
+        }else if(auto p = dynamic_cast<const parser::InfixExpression*>(node)){
+            put<uint8_t>(INFIX);
+            put<uint8_t>(p->op);
+            pending.push_back({p->right.get()});
+            pending.push_back({p->left.get()});
+        }else if(auto p = dynamic_cast<const parser::IfExpression*>(node)){
+            put<uint8_t>(IF);
+            pending.push_back({p->alternative.get()});
+            pending.push_back({p->consequence.get()});
+            pending.push_back({p->cond.get()});
+        }else if(auto p = dynamic_cast<const parser::FunctionLiteral*>(node)){
+            put<uint8_t>(FUNCTION);
+            put<uint32_t>(p->parameters.size());
+            for(auto &param : p->parameters){
+                sym(param->sym);
+            }
+            if(!p->parse_body()){
+                ok = false;
+            }
+            pending.push_back({p->body.get()});
+        }else if(auto p = dynamic_cast<const parser::CallExpression*>(node)){
+            put<uint8_t>(CALL);
+            list(p->arguments);
+            pending.push_back({p->function.get()});
+        }else{
+            put<uint8_t>(NONE);
+        }
+    }
+};
+
+// every read is bounds checked; a short or malformed file clears ok and
+// the caller falls back to parsing
+struct Reader {
+    const char *p;
+    const char *end;
+    parser::AstArena *arena;
+    std::shared_ptr<parser::AstArena> arena_handle;
+    std::vector<uint32_t> symbols;
+    std::vector<std::string_view> names;
+    bool ok = true;
+
+    // a place in the tree still to be read into, last first; like Writer,
+    // the walk keeps its own stack
+    struct Slot {
+        enum Kind : uint8_t {
+            // target is a StatementList: a count, then that many statements
+            STATEMENTS,
+            // target is a StatementList one statement is appended to
+            STATEMENT,
+            // target is a CallExpression: a count, then its arguments
+            ARGUMENTS,
+            // target is a NodePtr<Expression>
+            EXPRESSION,
+            // target is a NodePtr<BlockStatement>, which a BODY needs
+            BLOCK,
+            BODY,
+            // target is an ExpressionStatement whose expression is read
+            SPAN,
+        } kind;
+        void *target;
+    };
+    std::vector<Slot> pending;
+
+    Reader(const char *p, const char *end, std::shared_ptr<parser::AstArena> arena)
+        : p(p), end(end), arena(arena.get()), arena_handle(std::move(arena)) {}
+
+    template <typename T>
+    T get(){
+        T val{};
+        if(size_t(end - p) < sizeof(T)){
+            ok = false;
+            return val;
+        }
+        memcpy(&val, p, sizeof(T));
+        p += sizeof(T);
+        return val;
+    }
+
+    // a count can never be larger than the bytes left, which keeps a corrupt
+    // count from turning into a huge allocation
+    uint32_t count(){
+        uint32_t n = get<uint32_t>();
+        if(n > size_t(end - p)){
+            ok = false;
+            return 0;
+        }
+        return n;
+    }
+
+    parser::NodePtr<parser::Identifier> identifier(){
+        uint32_t i = get<uint32_t>();
+        if(i >= symbols.size()){
+            ok = false;
+            return nullptr;
+        }
+        // built by hand, the name is already interned
+        return parser::make_node<parser::Identifier>(arena,
+            arena->span(lexer::TokenType::ID, names[i]), symbols[i]);
+    }
+
+    uint32_t keyword(lexer::TokenType type){
+        return arena->span(type, lexer::token_spelling(type));
+    }
+
+    bool is_operator(uint8_t op){
+        return op < lexer::TOKEN_COUNT && !lexer::token_spelling(lexer::TokenType(op)).empty();
+    }
+
+    void statements(StatementList &list){
+        pending.push_back({Slot::STATEMENTS, &list});
+        while(!pending.empty() && ok){
+            Slot slot = pending.back();
+            pending.pop_back();
+            fill(slot);
+        }
+    }
+
+    void fill(Slot slot){
+        switch(slot.kind){
+            case Slot::STATEMENTS: {
+                uint32_t n = count();
+                static_cast<StatementList*>(slot.target)->reserve(n);
+                pending.insert(pending.end(), n, {Slot::STATEMENT, slot.target});
+                return;
+            }
+            case Slot::STATEMENT:
+                if(auto stmt = statement()){
+                    static_cast<StatementList*>(slot.target)->push_back(std::move(stmt));
+                }
+                return;
+            case Slot::ARGUMENTS: {
+                auto &args = static_cast<parser::CallExpression*>(slot.target)->arguments;
+                args.resize(count());
+                for(size_t i = args.size(); i-- > 0;){
+                    pending.push_back({Slot::EXPRESSION, &args[i]});
+                }
+                return;
+            }
+            case Slot::EXPRESSION:
+                *static_cast<parser::NodePtr<parser::Expression>*>(slot.target) = expression();
+                return;
+            case Slot::BLOCK:
+            case Slot::BODY: {
+                auto &block = *static_cast<parser::NodePtr<parser::BlockStatement>*>(slot.target);
+                block = this->block();
+                if(block == nullptr && slot.kind == Slot::BODY){
+                    ok = false;
+                }
+                return;
+            }
+            case Slot::SPAN: {
+                auto stmt = static_cast<parser::ExpressionStatement*>(slot.target);
+                if(stmt->expr != nullptr){
+                    stmt->span = stmt->expr->span;
+                }
+                return;
+            }
+        }
+    }
+
+    parser::NodePtr<parser::BlockStatement> block(){
+        uint8_t tag = get<uint8_t>();
+        if(tag == NONE){
+            return nullptr;
+        }
+        if(tag != BLOCK){
+            ok = false;
+            return nullptr;
+        }
+        auto block = parser::make_node<parser::BlockStatement>(arena);
+        block->span = keyword(lexer::TokenType::LBRAC);
+        pending.push_back({Slot::STATEMENTS, &block->statements});
+        return block;
+    }
+
+    // the statement, with its children left to the slots it pushes
+    parser::NodePtr<parser::Statement> statement(){
+        uint8_t tag = get<uint8_t>();
+        switch(tag){
+            case LET: {
+                auto stmt = parser::make_node<parser::LetStatement>(arena);
+                stmt->span = keyword(lexer::TokenType::LET);
+                stmt->name = identifier();
+                pending.push_back({Slot::EXPRESSION, &stmt->value});
+                return stmt;
+            }
+            case RETURN: {
+                auto stmt = parser::make_node<parser::ReturnStatement>(arena);
+                stmt->span = keyword(lexer::TokenType::RETURN);
+                pending.push_back({Slot::EXPRESSION, &stmt->return_value});
+                return stmt;
+            }
+            case EXPRESSION: {
+                auto stmt = parser::make_node<parser::ExpressionStatement>(arena);
+                pending.push_back({Slot::SPAN, stmt.get()});
+                pending.push_back({Slot::EXPRESSION, &stmt->expr});
+                return stmt;
+            }
+            case NONE:
+                return nullptr;
+        }
+        ok = false;
+        return nullptr;
+    }
+
+    // the expression, with its children left to the slots it pushes
+    parser::NodePtr<parser::Expression> expression(){
+        uint8_t tag = get<uint8_t>();
+        switch(tag){
+            case NONE:
+                return nullptr;
+            case IDENTIFIER:
+                return identifier();
+            case INTEGER: {
+                int64_t val = get<int64_t>();
+                return parser::make_node<parser::IntegerLiteral>(arena,
+                    arena->span(lexer::TokenType::INT, fmt::to_string(val)), val);
+            }
+            case BOOLEAN: {
+                bool val = get<uint8_t>() != 0;
+                return parser::make_node<parser::Boolean>(arena,
+                    keyword(val ? lexer::TokenType::TRUE : lexer::TokenType::FALSE), val);
+            }
+            case PREFIX: {
+                uint8_t op = get<uint8_t>();
+                if(!is_operator(op)){
+                    break;
+                }
+                auto exp = parser::make_node<parser::PrefixExpression>(arena);
+                exp->span = keyword(lexer::TokenType(op));
+                exp->op = lexer::TokenType(op);
+                pending.push_back({Slot::EXPRESSION, &exp->right});
+                return exp;
+            }
+            case INFIX: {
+                uint8_t op = get<uint8_t>();
+                if(!is_operator(op)){
+                    break;
+                }
+                auto exp = parser::make_node<parser::InfixExpression>(arena);
+                exp->span = keyword(lexer::TokenType(op));
+                exp->op = lexer::TokenType(op);
+                pending.push_back({Slot::EXPRESSION, &exp->right});
+                pending.push_back({Slot::EXPRESSION, &exp->left});
+                return exp;
+            }
+            case IF: {
+                auto exp = parser::make_node<parser::IfExpression>(arena);
+                exp->span = keyword(lexer::TokenType::IF);
+                pending.push_back({Slot::BLOCK, &exp->alternative});
+                pending.push_back({Slot::BLOCK, &exp->consequence});
+                pending.push_back({Slot::EXPRESSION, &exp->cond});
+                return exp;
+            }
+            case FUNCTION: {
+                auto lit = parser::make_node<parser::FunctionLiteral>(arena);
+                lit->span = keyword(lexer::TokenType::FUNCTION);
+                lit->arena = arena_handle;
+                uint32_t n = count();
+                for(uint32_t i = 0; i < n && ok; i++){
+                    lit->parameters.push_back(identifier());
+                }
+                pending.push_back({Slot::BODY, &lit->body});
+                return lit;
+            }
+            case CALL: {
+                auto exp = parser::make_node<parser::CallExpression>(arena);
+                exp->span = keyword(lexer::TokenType::LPAREN);
+                pending.push_back({Slot::ARGUMENTS, exp.get()});
+                pending.push_back({Slot::EXPRESSION, &exp->function});
+                return exp;
+            }
+        }
+        ok = false;
+        return nullptr;
+    }
+};
+
+}
+
+// 64-bit FNV-1a
+uint64_t hash(std::string_view data){
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(unsigned char c : data){
+        h ^= c;
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::string path_for(const std::string &script){
+    return script + "c";
+}
+
+std::string serialize(const parser::Program &program, std::string_view source, int opt_level){
+    Writer nodes;
+    nodes.statements(program.statements);
+    if(!nodes.ok){
+        return "";
+    }
+
+    Writer out;
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.opt_level = opt_level;
+    header.source_hash = hash(source);
+    header.source_size = source.size();
+    out.put(header);
+    out.put<uint32_t>(nodes.symbols.size());
+    for(uint32_t sym : nodes.symbols){
+        const std::string &name = lexer::symbol_name(sym);
+        out.put<uint32_t>(name.size());
+        out.out += name;
+    }
+    out.out += nodes.out;
+    return std::move(out.out);
+}
+
+parser::NodePtr<parser::Program> deserialize(std::string_view data, std::string_view source,
+    int opt_level){
+    Header header;
+    if(data.size() < sizeof(header)){
+        return nullptr;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if(memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.opt_level != uint32_t(opt_level) || header.source_size != source.size() ||
+        header.source_hash != hash(source)){
+        return nullptr;
+    }
+
+    auto program = parser::make_node<parser::Program>(nullptr);
+    program->arena = std::make_shared<parser::AstArena>();
+    Reader reader(data.data() + sizeof(header), data.data() + data.size(), program->arena);
+
+    uint32_t n = reader.count();
+    for(uint32_t i = 0; i < n && reader.ok; i++){
+        uint32_t len = reader.count();
+        if(!reader.ok){
+            break;
+        }
+        std::string_view name(reader.p, len);
+        reader.p += len;
+        reader.names.push_back(name);
+        reader.symbols.push_back(lexer::intern(name));
+    }
+    reader.statements(program->statements);
+    if(!reader.ok || reader.p != reader.end){
+        return nullptr;
+    }
+    resolver::resolve(*program);
+    return program;
+}
+
+parser::NodePtr<parser::Program> load(const std::string &script, std::string_view source,
+    int opt_level){
+    lexer::MappedFile file(path_for(script));
+    if(!file.is_open()){
+        return nullptr;
+    }
+    return deserialize(file.view(), source, opt_level);
+}
+
+// written to a temporary name and renamed, so a concurrent run never maps
+// a half-written cache
+bool store(const std::string &script, std::string_view source,
+    const parser::Program &program, int opt_level){
+    std::string data = serialize(program, source, opt_level);
+    if(data.empty()){
+        return false;
+    }
+    std::string path = path_for(script);
+    std::string tmp = fmt::format("{}.{}.tmp", path, getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if(f == nullptr){
+        return false;
+    }
+    bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+    ok = (fclose(f) == 0) && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str()) != 0){
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+void test_cache(){
+    std::vector<std::string> inputs = {
+        "let x = 5; return x;",
+        "-a * b + !c",
+        "a + b * c + d / e - f == 3 > 5",
+        "if (x < y) { x } else { y }; if (true) { 1 }",
+        "let add = fn(x, y) { x + y; }; add(1, 2 * 3, add(4, 5))",
+        "fn() { return true; }",
+    };
+    int passed = 0;
+    for(auto &input : inputs){
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        auto data = serialize(*program, input, 0);
+        auto loaded = deserialize(data, input, 0);
+        if(loaded == nullptr){
+            printf("[error] could not load the cache of %s\n", input.c_str());
+            continue;
+        }
+        if(loaded->string() != program->string()){
+            printf("[error] cache round trip: expected %s, got %s\n",
+                program->string().c_str(), loaded->string().c_str());
+            continue;
+        }
+        passed++;
+    }
+    // a tree far deeper than the native stack would allow to recurse over
+    std::string chain = "a";
+    for(size_t i = 0; i < 200000; i++){
+        chain += " + a";
+    }
+    lexer::Lexer chain_lexer(chain);
+    auto chain_parser = parser::Parser(chain_lexer);
+    chain_parser.max_nesting = chain.size();
+    auto sum = chain_parser.parse_program();
+    auto sum_data = serialize(*sum, chain, 0);
+    auto sum_loaded = deserialize(sum_data, chain, 0);
+    if(sum_loaded != nullptr && serialize(*sum_loaded, chain, 0) == sum_data){
+        passed++;
+    }else{
+        printf("[error] cache round trip of a long chain\n");
+    }
+    printf("[%d/%zu] test cases passed\n", passed, inputs.size() + 1);
+
+    // stale, mismatched or damaged caches are rejected, not half-loaded
+    std::string source = "let double = fn(x) { x * 2 }; double(double(3)) + double(1)";
+    lexer::Lexer l(source);
+    auto p = parser::Parser(l);
+    auto program = p.parse_program();
+    opt::optimize(*program, 1);
+    auto data = serialize(*program, source, 1);
+
+    passed = 0;
+    int total = 0;
+    auto check = [&](bool cond, const char *what){
+        total++;
+        if(!cond){
+            printf("[error] cache: %s\n", what);
+            return;
+        }
+        passed++;
+    };
+    check(deserialize(data, source + " ", 1) == nullptr, "changed source accepted");
+    check(deserialize(data, source, 0) == nullptr, "other opt level accepted");
+    check(deserialize(data.substr(0, data.size() - 1), source, 1) == nullptr,
+        "truncated cache accepted");
+    check(deserialize(data + "x", source, 1) == nullptr, "trailing bytes accepted");
+
+    auto loaded = deserialize(data, source, 1);
+    check(loaded != nullptr, "fresh cache rejected");
+    if(loaded != nullptr){
+        auto environment = object::new_environment();
+        auto evaluated = eval::eval(*loaded, environment);
+        check(evaluated && evaluated.inspect() == "14",
+            "loaded program evaluates differently");
+    }
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+}
@@ -0,0 +1,49 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+// precompiled AST cache. a parsed (and optimized) Program is written to
+// <script>c, e.g. fib.monkey -> fib.monkeyc, in a compact binary form:
+//
+//   header   magic "MONKEYC", format version, opt level, FNV-1a hash and
+//            size of the source it was built from
+//   symbols  count, then every identifier name used (u32 length + bytes)
+//   nodes    the tree in pre-order, one kind byte per node followed by
+//            its fields and then its children
+//
+// loading maps the file and rebuilds the tree into a fresh arena in one
+// pass over the bytes, without touching the lexer or parser, and resolves
+// it (resolver.h), since slots are not part of the file. a cache
+// whose header does not match the current source, version or opt level,
+// or that is truncated, is ignored and rewritten
+
+#include "parser.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace cache {
+
+constexpr uint32_t VERSION = 1;
+
+uint64_t hash(std::string_view data);
+std::string path_for(const std::string &script);
+
+// bodies skipped by a lazy parse are parsed first; empty if one of them
+// does not parse
+std::string serialize(const parser::Program &program, std::string_view source, int opt_level);
+// null if data was not built from this source with this opt level
+parser::NodePtr<parser::Program> deserialize(std::string_view data, std::string_view source,
+    int opt_level);
+
+// read or write the cache file that belongs to script
+parser::NodePtr<parser::Program> load(const std::string &script, std::string_view source,
+    int opt_level);
+bool store(const std::string &script, std::string_view source,
+    const parser::Program &program, int opt_level);
+
+void test_cache();
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "evaluator.h"
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <utility>
@@ -7,310 +8,318 @@
 
 namespace eval {
 
-std::unique_ptr<object::Error> new_error(std::string message){
-    return std::make_unique<object::Error>(message);
+object::Value new_error(std::string message){
+    return object::Value::make<object::Error>(std::move(message));
 }
 
-bool is_error(const object::Object* obj){
-    if(obj != nullptr){
-        return obj->type() == object::ERROR_OBJ;
-    }
-    return false;
+bool is_error(const object::Value &obj){
+    return obj.is_error();
 }
 
-std::unique_ptr<object::Object> eval_minus_prefix_operator_expression(
-    std::unique_ptr<object::Object> right){
-    if(right->type() != object::INTEGER_OBJ){
-        return new_error(fmt::format("unknown operator: -{}", right->type())); 
+object::Value eval_minus_prefix_operator_expression(object::Value right){
+    if(right.tag != object::Tag::INTEGER){
+        return new_error(fmt::format("unknown operator: -{}", right.type())); 
     }
-
-    auto ptr = dynamic_cast<object::Integer*>(right.get());
-    ptr->value = -1 * ptr->value;
-    return right;
+    return object::Value::from_int(-right.integer);
 }
 
-std::unique_ptr<object::Object> eval_boolean_infix_expression(std::string op,
-    std::unique_ptr<object::Object> left, std::unique_ptr<object::Object> right){
-    auto left_val = dynamic_cast<object::Boolean*>(left.get())->value;
-    auto right_val = dynamic_cast<object::Boolean*>(right.get())->value;
-
-    if(op == "=="){
-        return std::make_unique<object::Boolean>(left_val == right_val);
-    }else if(op == "!="){
-        return std::make_unique<object::Boolean>(left_val != right_val);
+object::Value eval_boolean_infix_expression(lexer::TokenType op,
+    const object::Value &left, const object::Value &right){
+    switch(op){
+        case lexer::TokenType::EQ:
+            return object::Value::from_bool(left.boolean == right.boolean);
+        case lexer::TokenType::NEQ:
+            return object::Value::from_bool(left.boolean != right.boolean);
+        default:
+            break;
     }
     return new_error(fmt::format("unknown operator: {} {} {}", 
-        left->type(), op, right->type()));
+        left.type(), lexer::token_spelling(op), right.type()));
 }
 
-std::unique_ptr<object::Object> eval_integer_infix_expression(std::string op,
-    std::unique_ptr<object::Object> left, std::unique_ptr<object::Object> right){
-    auto left_val = dynamic_cast<object::Integer*>(left.get())->value;
-    auto right_val = dynamic_cast<object::Integer*>(right.get())->value;
-
-    if(op == "+"){
-        return std::make_unique<object::Integer>(left_val + right_val);
-    }else if(op == "-"){
-        return std::make_unique<object::Integer>(left_val - right_val);
-    }else if(op == "*"){
-        return std::make_unique<object::Integer>(left_val * right_val);
-    }else if(op == "/"){
-        return std::make_unique<object::Integer>(left_val / right_val);
-    }else if(op == "<"){
-        return std::make_unique<object::Boolean>(left_val < right_val);
-    }else if(op == ">"){
-        return std::make_unique<object::Boolean>(left_val > right_val);
-    }else if(op == "=="){
-        return std::make_unique<object::Boolean>(left_val == right_val);
-    }else if(op == "!="){
-        return std::make_unique<object::Boolean>(left_val != right_val);
+object::Value eval_integer_infix_expression(lexer::TokenType op,
+    const object::Value &left, const object::Value &right){
+    auto left_val = left.integer;
+    auto right_val = right.integer;
+
+    switch(op){
+        case lexer::TokenType::PLUS:
+            return object::Value::from_int(left_val + right_val);
+        case lexer::TokenType::MINUS:
+            return object::Value::from_int(left_val - right_val);
+        case lexer::TokenType::ASTERISK:
+            return object::Value::from_int(left_val * right_val);
+        case lexer::TokenType::FSLASH:
+            return object::Value::from_int(left_val / right_val);
+        case lexer::TokenType::LT:
+            return object::Value::from_bool(left_val < right_val);
+        case lexer::TokenType::GT:
+            return object::Value::from_bool(left_val > right_val);
+        case lexer::TokenType::EQ:
+            return object::Value::from_bool(left_val == right_val);
+        case lexer::TokenType::NEQ:
+            return object::Value::from_bool(left_val != right_val);
+        default:
+            break;
     }
 
     return new_error(fmt::format("unknown operator: {} {} {}", 
-        left->type(), op, right->type()));
+        left.type(), lexer::token_spelling(op), right.type()));
 }
 
-std::unique_ptr<object::Object> eval_bang_operator_expression(std::unique_ptr<object::Object> right){
-    if(auto ptr = dynamic_cast<object::Boolean*>(right.get())){
-        if(ptr->value == true){
-            return std::make_unique<object::Boolean>(false);
-        }else{
-            return std::make_unique<object::Boolean>(true);
-        }
-    }else if(auto ptr = dynamic_cast<object::Null*>(right.get())){
-        return std::make_unique<object::Boolean>(true);
-    }else if(auto ptr = dynamic_cast<object::Integer*>(right.get())){
-        if(ptr->value == 0){
-            return std::make_unique<object::Boolean>(true);
-        }else{
-            return std::make_unique<object::Boolean>(false);
-        }
+object::Value eval_bang_operator_expression(const object::Value &right){
+    switch(right.tag){
+        case object::Tag::BOOLEAN:
+            return object::Value::from_bool(!right.boolean);
+        case object::Tag::NIL:
+            return object::Value::from_bool(true);
+        case object::Tag::INTEGER:
+            return object::Value::from_bool(right.integer == 0);
+        default:
+            return object::Value::from_bool(false);
     }
-    return std::make_unique<object::Boolean>(false);
 }
 
-std::unique_ptr<object::Object> eval_prefix_expression(std::string op, 
-    std::unique_ptr<object::Object> right){
-    if(op == "!"){
-        return eval_bang_operator_expression(std::move(right));
-    }else if(op == "-"){
-        return eval_minus_prefix_operator_expression(std::move(right));
+object::Value eval_prefix_expression(lexer::TokenType op, object::Value right){
+    switch(op){
+        case lexer::TokenType::BANG:
+            return eval_bang_operator_expression(right);
+        case lexer::TokenType::MINUS:
+            return eval_minus_prefix_operator_expression(std::move(right));
+        default:
+            break;
     }
 
-    return new_error(fmt::format("unknown operator: {} {}", op, right->type()));
+    return new_error(fmt::format("unknown operator: {} {}", lexer::token_spelling(op),
+        right.type()));
 }
 
-std::unique_ptr<object::Object> eval_infix_expression(std::string op,
-    std::unique_ptr<object::Object> left,
-    std::unique_ptr<object::Object> right){
-    auto left_type = left->type();
-    auto right_type = right->type();
-
-    if(left_type == object::INTEGER_OBJ && right_type == object::INTEGER_OBJ){
-        return eval_integer_infix_expression(op, std::move(left), std::move(right));
-    }else if(left_type == object::BOOLEAN_OBJ && right_type == object::BOOLEAN_OBJ){
-        return eval_boolean_infix_expression(op, std::move(left), std::move(right));
-    }else if(left_type != right_type){
+object::Value eval_infix_expression(lexer::TokenType op, object::Value left,
+    object::Value right){
+    if(left.tag == object::Tag::INTEGER && right.tag == object::Tag::INTEGER){
+        return eval_integer_infix_expression(op, left, right);
+    }else if(left.tag == object::Tag::BOOLEAN && right.tag == object::Tag::BOOLEAN){
+        return eval_boolean_infix_expression(op, left, right);
+    }else if(left.type() != right.type()){
         return new_error(fmt::format("type mismatch: {} {} {}", 
-            left_type, op, right_type)); 
+            left.type(), lexer::token_spelling(op), right.type())); 
     }
-    return new_error(fmt::format("unknown operator: {} {} {}", left_type, op, right_type));
+    return new_error(fmt::format("unknown operator: {} {} {}", left.type(),
+        lexer::token_spelling(op), right.type()));
 }
 
-bool is_truthy(std::unique_ptr<object::Object> obj){
-    if(auto ptr = dynamic_cast<object::Null*>(obj.get())){
-        return false;
-    }else if(auto ptr = dynamic_cast<object::Boolean*>(obj.get())){
-        return ptr->value;
+bool is_truthy(const object::Value &obj){
+    switch(obj.tag){
+        case object::Tag::NIL:
+            return false;
+        case object::Tag::BOOLEAN:
+            return obj.boolean;
+        default:
+            return true;
     }
-    return true;
 }
 
-std::unique_ptr<object::Object> eval_if_expression(
-    std::unique_ptr<parser::Node> node,
-    std::unique_ptr<object::Environment> &environment){
-    auto ptr = dynamic_cast<parser::IfExpression*>(node.get());
-    auto cond = eval(std::move(ptr->cond), environment);
-    if (is_error(dynamic_cast<const object::Object *>(cond.get()))) {
+object::Value eval_if_expression(const parser::IfExpression &node,
+    const object::Ref<object::Environment> &environment){
+    auto cond = eval(*node.cond, environment);
+    if (is_error(cond)) {
       return cond;
     }
-    auto cond_val = is_truthy(std::move(cond)); 
-    if(cond_val){
-        return eval(std::move(ptr->consequence), environment);
+    if(is_truthy(cond)){
+        return eval(*node.consequence, environment);
     }else{
-        if(ptr->alternative != nullptr){
-            return eval(std::move(ptr->alternative), environment);
+        if(node.alternative != nullptr){
+            return eval(*node.alternative, environment);
         }
     }
-    return std::make_unique<object::Null>();
+    return object::Value::null();
 }
 
-std::unique_ptr<object::Object> eval_program(std::unique_ptr<parser::Node> node,
-    std::unique_ptr<object::Environment> &environment){
-    auto result = std::unique_ptr<object::Object>();
-    auto program_ptr = dynamic_cast<parser::Program*>(node.get());
-    for(int i=0; i<program_ptr->statements.size(); i++){
-        result = eval(std::move(program_ptr->statements[i]), environment); 
-        if(auto return_value = dynamic_cast<object::ReturnValue*>(result.get())){
-            return std::move(return_value->value);
+object::Value eval_program(const parser::Program &program,
+    const object::Ref<object::Environment> &environment){
+    object::Value result;
+    for(auto &stmt : program.statements){
+        gc::safepoint();
+        result = eval(*stmt, environment); 
+        if(result.returning){
+            result.returning = false;
+            return result;
         }
-        if(auto err = dynamic_cast<object::Error*>(result.get())){
+        if(is_error(result)){
             return result;
         }
     }
     return result;
 }
 
-std::unique_ptr<object::Object> eval_identifier(std::unique_ptr<parser::Node> node,
-    std::unique_ptr<object::Environment> &environment){
-    auto id_ptr = dynamic_cast<parser::Identifier*>(node.get());
-    auto [val, ok] = environment->get(id_ptr->value);
+object::Value eval_identifier(const parser::Identifier &node,
+    const object::Ref<object::Environment> &environment){
+    auto [val, ok] = environment->get(node.depth, node.slot);
     if(!ok){
-        return new_error(fmt::format("identifier not found: {}", id_ptr->value));
+        return new_error(fmt::format("identifier not found: {}", node.name()));
     }
     return std::move(val);
 }
 
-std::unique_ptr<object::Object> eval_block_statement(std::unique_ptr<parser::Node> node,
-    std::unique_ptr<object::Environment> &environment){
-    auto result = std::unique_ptr<object::Object>();
-    auto block_ptr = dynamic_cast<parser::BlockStatement*>(node.get());
-    for(int i=0; i<block_ptr->statements.size(); i++){
-        result = eval(std::move(block_ptr->statements[i]), environment); 
-        if((result != nullptr)){ 
-            if(result->type() == object::RETURN_VALUE_OBJ || result->type() == object::ERROR_OBJ){
-                return result;
-            }
+object::Value eval_block_statement(const parser::BlockStatement &block,
+    const object::Ref<object::Environment> &environment){
+    object::Value result;
+    for(auto &stmt : block.statements){
+        gc::safepoint();
+        result = eval(*stmt, environment); 
+        if(result.returning || is_error(result)){
+            return result;
         }
     }
     return result;
 }
 
-std::vector<std::unique_ptr<object::Object>> eval_expressions(
-    std::vector<std::unique_ptr<parser::Expression>> exps, 
-    std::unique_ptr<object::Environment> &env){
-    std::vector<std::unique_ptr<object::Object>> result;
-    for(int i=0; i<exps.size(); i++){
-        auto evaluated = eval(std::move(exps[i]), env);
-        if(is_error(evaluated.get())){
+std::vector<object::Value> eval_expressions(
+    const std::vector<parser::NodePtr<parser::Expression>> &exps, 
+    const object::Ref<object::Environment> &env){
+    std::vector<object::Value> result;
+    for(auto &exp : exps){
+        auto evaluated = eval(*exp, env);
+        if(is_error(evaluated)){
+            result.clear();
             result.push_back(std::move(evaluated));
             return result;
         }
         result.push_back(std::move(evaluated));
     }
-    return std::move(result);
+    return result;
 }
 
-std::unique_ptr<object::Environment> extended_function_env(
-    object::Function* fn, std::vector<std::unique_ptr<object::Object>> args){
-    auto env = object::new_enclosed_environment(fn->environment);
-    for(int i=0; i<fn->parameters.size(); i++){
-        env->set(fn->parameters[i]->value, std::move(args[i]));
+object::Ref<object::Environment> extended_function_env(
+    const object::Function* fn, std::vector<object::Value> args){
+    auto env = object::new_enclosed_environment(fn->environment, fn->literal->frame_size);
+    auto &parameters = fn->literal->parameters;
+    for(int i=0; i<parameters.size(); i++){
+        env->set(parameters[i]->slot, std::move(args[i]));
     }
     return env;
 }
 
-std::unique_ptr<object::Object> unwrap_return_value(std::unique_ptr<object::Object> obj){
-    if(auto ptr = dynamic_cast<object::ReturnValue*>(obj.get())){
-        return std::move(ptr->value);
-    }
+object::Value unwrap_return_value(object::Value obj){
+    obj.returning = false;
     return obj;
 } 
 
-std::unique_ptr<object::Object> apply_function(std::unique_ptr<object::Object> fn, 
-    std::vector<std::unique_ptr<object::Object>> args){
-    auto function = dynamic_cast<object::Function*>(fn.get());
+object::Value apply_function(object::Value fn, std::vector<object::Value> args){
+    auto function = fn.as<object::Function>();
     if(function == nullptr){
-        return new_error(fmt::format("not a function: {}", fn->type()));
+        return new_error(fmt::format("not a function: {}", fn.type()));
     }
 
+    // a body skipped by a lazy parse is parsed on its first call
+    if(!function->literal->parse_body()){
+        return new_error(fmt::format("in function body: {}",
+            function->literal->body_errors.front()));
+    }
+    auto &parameters = function->literal->parameters;
+    if(args.size() != parameters.size()){
+        return new_error(fmt::format("wrong number of arguments: want={}, got={}",
+            parameters.size(), args.size()));
+    }
     auto extended_env = extended_function_env(function, std::move(args));
-    auto evaluated = eval(std::move(function->body), extended_env);
-    return evaluated;
+    auto evaluated = eval(*function->literal->body, extended_env);
+    return unwrap_return_value(std::move(evaluated));
+}
+
+// a function shares its literal with the tree instead of copying it. an
+// arena-parsed tree is kept alive through its arena; a heap-parsed one is
+// copied once here, since its Program may be dropped before the function.
+// the copy still holds the arena, which has the spans of its nodes
+std::shared_ptr<const parser::FunctionLiteral> share_literal(
+    const parser::FunctionLiteral &literal){
+    auto arena = literal.arena.lock();
+    if(literal.arena_owned && arena != nullptr){
+        return std::shared_ptr<const parser::FunctionLiteral>(std::move(arena), &literal);
+    }
+    return std::shared_ptr<const parser::FunctionLiteral>(
+        static_cast<parser::FunctionLiteral*>(literal.clone().release()),
+        [arena = std::move(arena)](const parser::FunctionLiteral *p){ delete p; });
 }
 
-std::unique_ptr<object::Object> eval(std::unique_ptr<parser::Node> node, 
-    std::unique_ptr<object::Environment> &environment){
-    if(auto ptr = dynamic_cast<parser::CallExpression*>(node.get())){
-        auto function = eval(std::move(ptr->function), environment);
-        if(is_error(function.get())){
+object::Value eval(const parser::Node &node, 
+    const object::Ref<object::Environment> &environment){
+    if(auto ptr = dynamic_cast<const parser::CallExpression*>(&node)){
+        auto function = eval(*ptr->function, environment);
+        if(is_error(function)){
             return function;
         }
-        auto args = 
-            std::move(eval_expressions(std::move(ptr->arguments), environment));
-        if(args.size() == 1 && is_error(args[0].get())){
+        auto args = eval_expressions(ptr->arguments, environment);
+        if(args.size() == 1 && is_error(args[0])){
             return std::move(args[0]);
         }
         return apply_function(std::move(function), std::move(args));
-    }else if(auto ptr = dynamic_cast<parser::FunctionLiteral*>(node.get())){
-        auto params = std::move(ptr->parameters);
-        auto body = std::move(ptr->body);
-        return std::make_unique<object::Function>(std::move(params), std::move(body), environment);
-    }else if(auto ptr = dynamic_cast<parser::LetStatement*>(node.get())){
-        auto val = eval(std::move(ptr->value), environment);
-        if(is_error(val.get())){
+    }else if(auto ptr = dynamic_cast<const parser::FunctionLiteral*>(&node)){
+        return object::Value::make<object::Function>(share_literal(*ptr), environment);
+    }else if(auto ptr = dynamic_cast<const parser::LetStatement*>(&node)){
+        auto val = eval(*ptr->value, environment);
+        if(is_error(val)){
             return val;
         }
-        environment->set(ptr->name->value, std::move(val));
-    }else if(auto ptr = dynamic_cast<parser::Identifier*>(node.get())){
-        return eval_identifier(std::move(node), environment);
-    }else if(auto ptr = dynamic_cast<parser::ExpressionStatement*>(node.get())){
-        return eval(std::move(ptr->expr), environment);
-    }else if(auto ptr = dynamic_cast<const parser::IntegerLiteral*>(node.get())){
-        return std::make_unique<object::Integer>(ptr->val);
-    }else if(auto ptr = dynamic_cast<const parser::Boolean*>(node.get())){
-        return std::make_unique<object::Boolean>(ptr->val);
-    }else if(auto ptr = dynamic_cast<parser::PrefixExpression*>(node.get())){
-        auto right = eval(std::move(ptr->right), environment);
-        if(is_error(dynamic_cast<const object::Object*>(right.get()))){
+        environment->set(ptr->name->slot, std::move(val));
+    }else if(auto ptr = dynamic_cast<const parser::Identifier*>(&node)){
+        return eval_identifier(*ptr, environment);
+    }else if(auto ptr = dynamic_cast<const parser::ExpressionStatement*>(&node)){
+        return eval(*ptr->expr, environment);
+    }else if(auto ptr = dynamic_cast<const parser::IntegerLiteral*>(&node)){
+        return object::Value::from_int(ptr->val);
+    }else if(auto ptr = dynamic_cast<const parser::Boolean*>(&node)){
+        return object::Value::from_bool(ptr->val);
+    }else if(auto ptr = dynamic_cast<const parser::PrefixExpression*>(&node)){
+        auto right = eval(*ptr->right, environment);
+        if(is_error(right)){
             return right;
         }
         return eval_prefix_expression(ptr->op, std::move(right));
-    }else if(auto ptr = dynamic_cast<parser::InfixExpression*>(node.get())){
-        auto left = eval(std::move(ptr->left), environment);
-        if(is_error(dynamic_cast<const object::Object*>(left.get()))){
+    }else if(auto ptr = dynamic_cast<const parser::InfixExpression*>(&node)){
+        auto left = eval(*ptr->left, environment);
+        if(is_error(left)){
             return left;
         }
-        auto right = eval(std::move(ptr->right), environment);
-        if(is_error(dynamic_cast<const object::Object*>(right.get()))){
+        auto right = eval(*ptr->right, environment);
+        if(is_error(right)){
             return right;
         }
         return eval_infix_expression(ptr->op, std::move(left), std::move(right));
-    }else if(auto ptr = dynamic_cast<parser::BlockStatement*>(node.get())){
-        return eval_block_statement(std::move(node), environment);
-    }else if(auto ptr = dynamic_cast<parser::IfExpression*>(node.get())){
-        return eval_if_expression(std::move(node), environment);
-    }else if(auto ptr = dynamic_cast<parser::ReturnStatement*>(node.get())){
-        auto val = eval(std::move(ptr->return_value), environment);
-        if(is_error(dynamic_cast<const object::Object*>(val.get()))){
+    }else if(auto ptr = dynamic_cast<const parser::BlockStatement*>(&node)){
+        return eval_block_statement(*ptr, environment);
+    }else if(auto ptr = dynamic_cast<const parser::IfExpression*>(&node)){
+        return eval_if_expression(*ptr, environment);
+    }else if(auto ptr = dynamic_cast<const parser::ReturnStatement*>(&node)){
+        auto val = eval(*ptr->return_value, environment);
+        if(is_error(val)){
             return val;
         }
-        return std::make_unique<object::ReturnValue>(std::move(val));
-    }else if(auto ptr = dynamic_cast<parser::Program*>(node.get())){
-        return eval_program(std::move(node), environment);
+        val.returning = true;
+        return val;
+    }else if(auto ptr = dynamic_cast<const parser::Program*>(&node)){
+        return eval_program(*ptr, environment);
     }    
     
-    return nullptr;
+    return object::Value();
 }
 
-std::unique_ptr<object::Object> test_eval(std::string input){
+object::Value test_eval(std::string input){
     auto l = lexer::Lexer(input);
     auto p = parser::Parser(l);
-    auto environment = std::make_unique<object::Environment>(nullptr);
+    auto environment = object::new_environment();
     auto program = p.parse_program();
 
-    return eval(std::move(program), environment);
+    return eval(*program, environment);
 }
 
-void test_integer_object(std::unique_ptr<object::Object> evaluated, int64_t expected){
-    auto result = dynamic_cast<const object::Integer*>(evaluated.get());
-    if(result == nullptr){
+void test_integer_object(const object::Value &evaluated, int64_t expected){
+    if(evaluated.tag != object::Tag::INTEGER){
         printf("[error] object is not integer \n");
         return;
     }
-    if(result->value != expected){
+    if(evaluated.integer != expected){
         printf("[error] integer value does not match: eval: %ld, exp: %ld\n",
-            result->value, expected);
+            evaluated.integer, expected);
         return;
     }
     return;
@@ -333,4 +342,239 @@ void test_eval_integer_expression(){
     }
 }
 
-}
\ No newline at end of file
+void test_eval_reuses_ast(){
+    std::string input = "let double = fn(x) { x * 2 }; double(double(3)) + double(1)";
+    auto l = lexer::Lexer(input);
+    auto p = parser::Parser(l);
+    auto program = p.parse_program();
+    std::string before = program->string();
+
+    int passed = 0;
+    for(int run = 0; run < 3; run++){
+        auto environment = object::new_environment();
+        auto evaluated = eval(*program, environment);
+        if(evaluated.tag != object::Tag::INTEGER || evaluated.integer != 14){
+            printf("[error] run %d of the same program gave %s\n", run,
+                evaluated ? evaluated.inspect().c_str() : "nullptr");
+            continue;
+        }
+        passed++;
+    }
+    if(program->string() != before){
+        printf("[error] evaluation changed the program\n");
+    }
+    printf("[%d/3] test cases passed\n", passed);
+}
+
+void test_eval_lazy_bodies(){
+    // a lazy parse must evaluate exactly like an eager one
+    std::vector<std::string> programs = {
+        "let add = fn(a, b) { a + b }; add(2, 3) * 2",
+        "let f = fn(x) { let g = fn(y) { y * 2 }; g(x) + 1 }; f(5)",
+        "let f = fn() { if (1 < 2) { 10 } else { 20 } }; f()",
+        "let f = fn(x) { return x; 9 }; f(7)",
+        "let unused = fn(x) { x + x }; 3",
+    };
+    int passed = 0;
+    for(auto &input : programs){
+        auto expected = test_eval(input);
+
+        // the source is gone before anything is evaluated
+        auto source = std::make_unique<std::string>(input);
+        lexer::Lexer l(*source);
+        auto p = parser::Parser(l);
+        p.lazy_bodies = true;
+        auto program = p.parse_program();
+        source.reset();
+
+        auto environment = object::new_environment();
+        auto got = eval(*program, environment);
+        std::string want = expected ? expected.inspect() : "nullptr";
+        std::string have = got ? got.inspect() : "nullptr";
+        if(!p.errors.empty() || want != have){
+            printf("[error] lazy eval of %s: expected %s, got %s\n", input.c_str(),
+                want.c_str(), have.c_str());
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, programs.size());
+
+    passed = 0;
+    int total = 0;
+    auto check = [&](bool cond, const char *what){
+        total++;
+        if(!cond){
+            printf("[error] lazy bodies: %s\n", what);
+            return;
+        }
+        passed++;
+    };
+    auto parse = [](std::string input, bool lazy){
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        p.lazy_bodies = lazy;
+        auto program = p.parse_program();
+        return std::make_pair(std::move(program), p.errors);
+    };
+
+    auto [lazy, lazy_errors] = parse("let f = fn(x) { x * 2 }; f(4); f(5)", true);
+    auto stmt = dynamic_cast<parser::LetStatement*>(lazy->statements[0].get());
+    auto lit = stmt ? dynamic_cast<parser::FunctionLiteral*>(stmt->value.get()) : nullptr;
+    check(lit != nullptr && lit->body == nullptr, "body parsed up front");
+    auto environment = object::new_environment();
+    auto evaluated = eval(*lazy, environment);
+    check(evaluated && evaluated.inspect() == "10", "wrong result");
+    check(lit != nullptr && lit->body != nullptr && lit->lazy_tokens == nullptr,
+        "body not kept after the first call");
+
+    // a broken body is only an error once it is called
+    std::string broken = "let bad = fn() { let = 1; }; ";
+    auto [eager, eager_errors] = parse(broken + "5", false);
+    check(!eager_errors.empty(), "eager parse missed the error");
+    auto [unused, unused_errors] = parse(broken + "5", true);
+    environment = object::new_environment();
+    evaluated = eval(*unused, environment);
+    check(unused_errors.empty() && evaluated && evaluated.inspect() == "5",
+        "uncalled broken body failed");
+    auto [called, called_errors] = parse(broken + "bad()", true);
+    environment = object::new_environment();
+    evaluated = eval(*called, environment);
+    check(evaluated && evaluated.inspect().starts_with("ERROR: in function body: "),
+        "called broken body did not fail");
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+
+void test_eval_values(){
+    struct Test {
+        std::string input;
+        std::string expected;
+        object::Tag tag;
+    };
+    std::vector<Test> tests = {
+        {"5 * (2 + 3)", "25", object::Tag::INTEGER},
+        {"!5", "false", object::Tag::BOOLEAN},
+        {"1 < 2 == true", "true", object::Tag::BOOLEAN},
+        {"if (false) { 1 }", "null", object::Tag::NIL},
+        {"let a = 1;", "", object::Tag::NONE},
+        {"5 + true", "ERROR: type mismatch: INTEGER + BOOLEAN", object::Tag::ERROR},
+        {"-true", "ERROR: unknown operator: -BOOLEAN", object::Tag::ERROR},
+        {"true + false", "ERROR: unknown operator: BOOLEAN + BOOLEAN", object::Tag::ERROR},
+        {"let f = fn(x) { x }; f", "fn(x){\n{\nx\n}\n}", object::Tag::FUNCTION},
+        {"5(1)", "ERROR: not a function: INTEGER", object::Tag::ERROR},
+        {"let f = fn(a, b) { a }; f(1)", "ERROR: wrong number of arguments: want=2, got=1",
+            object::Tag::ERROR},
+        {"fn() { 1 }(2)", "ERROR: wrong number of arguments: want=0, got=1",
+            object::Tag::ERROR},
+        // a return stops at the call it leaves
+        {"let f = fn(x) { return x; 9 }; f(1) + f(2)", "3", object::Tag::INTEGER},
+        {"let f = fn() { return 1; }; f(); 2", "2", object::Tag::INTEGER},
+        {"if (true) { return 4; 5 }; 6", "4", object::Tag::INTEGER},
+        // names are looked up in the scopes a function was written in
+        {"let k = fn(a) { fn(b) { a + b } }; let addtwo = k(2); addtwo(3)", "5",
+            object::Tag::INTEGER},
+        {"let n = 10; let f = fn(x) { x + n }; f(1)", "11", object::Tag::INTEGER},
+        {"let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; fib(10)",
+            "55", object::Tag::INTEGER},
+        {"let x = 1; let f = fn(x) { let y = x * 2; y }; f(5) + x", "11",
+            object::Tag::INTEGER},
+        {"let f = fn() { let y = x; let x = 1; y }; let x = 2; f()",
+            "ERROR: identifier not found: x", object::Tag::ERROR},
+    };
+    int passed = 0;
+    for(auto &test : tests){
+        auto evaluated = test_eval(test.input);
+        if(evaluated.tag != test.tag || evaluated.returning ||
+            evaluated.inspect() != test.expected){
+            printf("[error] %s: expected %s (%s), got %s (%s)\n", test.input.c_str(),
+                test.expected.c_str(), std::string(object::type_name(test.tag)).c_str(),
+                evaluated.inspect().c_str(), std::string(evaluated.type()).c_str());
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, tests.size());
+}
+
+// reads and writes through an environment share the object instead of
+// copying it, and a closure keeps the scope it was created in
+void test_eval_shares_objects(){
+    int passed = 0, total = 0;
+    auto check = [&](bool ok, const char *what){
+        total++;
+        if(ok){
+            passed++;
+        }else{
+            printf("[error] %s\n", what);
+        }
+    };
+
+    std::string input = "let f = fn(x) { x }; let g = f; let h = fn() { f };";
+    auto l = lexer::Lexer(input);
+    auto p = parser::Parser(l);
+    auto program = p.parse_program();
+    auto environment = object::new_environment();
+    eval(*program, environment);
+
+    auto [f, f_ok] = environment->get(0, lexer::intern("f"));
+    auto [g, g_ok] = environment->get(0, lexer::intern("g"));
+    auto [h, h_ok] = environment->get(0, lexer::intern("h"));
+    check(f_ok && g_ok && h_ok, "bindings missing");
+    check(f.as<object::Function>() != nullptr && f.object == g.object,
+        "let copied the function");
+    // f and g in the store, plus the two values read here
+    check(f.object != nullptr && f.object->refs == 4, "unexpected reference count");
+    auto closure = h.as<object::Function>();
+    check(closure != nullptr && closure->environment.get() == environment.get(),
+        "closure did not keep its environment");
+
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+// every call of f leaves its scope and g pointing at each other; the
+// collector has to free them while the program runs
+void test_eval_collects_cycles(){
+    int passed = 0, total = 0;
+    auto check = [&](bool ok, const char *what){
+        total++;
+        if(ok){
+            passed++;
+        }else{
+            printf("[error] %s\n", what);
+        }
+    };
+
+    gc::collect(true);
+    size_t live = gc::heap.young_count + gc::heap.old_count;
+    uint64_t collections = gc::heap.stats.young_collections;
+    std::string input = "let f = fn() { let g = fn() { 1 }; g() };";
+    for(int i = 0; i < 500; i++){
+        input += " f();";
+    }
+    size_t limit = gc::heap.config.young_limit;
+    gc::heap.config.young_limit = 64;
+    {
+        auto l = lexer::Lexer(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        auto environment = object::new_environment();
+        size_t peak = 0;
+        for(auto &stmt : program->statements){
+            auto evaluated = eval(*stmt, environment);
+            check(evaluated.tag != object::Tag::ERROR, "program failed");
+            peak = std::max(peak, gc::heap.young_count + gc::heap.old_count - live);
+            gc::safepoint();
+        }
+        check(gc::heap.stats.young_collections > collections, "no collection ran");
+        check(peak <= 64 + 8, "cycles piled up between collections");
+    }
+    gc::heap.config.young_limit = limit;
+    gc::collect(true);
+    check(gc::heap.young_count + gc::heap.old_count == live,
+        "a full collection left the program's cells behind");
+
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+}
@@ -7,12 +7,28 @@
 
 namespace eval {
 
-std::unique_ptr<object::Object> eval(std::unique_ptr<parser::Node> node,
-    std::unique_ptr<object::Environment> &environment);
-std::unique_ptr<object::Object> test_eval(std::string input);
+// evaluation only reads the tree, so a program can be run any number of
+// times and function objects point into it instead of owning a copy
+object::Value eval(const parser::Node &node,
+    const object::Ref<object::Environment> &environment);
+object::Value test_eval(std::string input);
+
+// shared with the flat evaluator
+object::Value new_error(std::string message);
+bool is_error(const object::Value &obj);
+bool is_truthy(const object::Value &obj);
+// operators are dispatched on the operator token's type
+object::Value eval_prefix_expression(lexer::TokenType op, object::Value right);
+object::Value eval_infix_expression(lexer::TokenType op, object::Value left,
+    object::Value right);
 
 void test_integer_object();
 void test_eval_integer_expression();
+void test_eval_reuses_ast();
+void test_eval_lazy_bodies();
+void test_eval_values();
+void test_eval_shares_objects();
+void test_eval_collects_cycles();
 
 }
 
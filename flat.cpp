@@ -0,0 +1,434 @@
+#include "flat.h"
+#include "evaluator.h"
+#include <cstdio>
+#include <fmt/format.h>
+#include <memory>
+#include <utility>
+
+namespace flat {
+
+namespace {
+
+struct Builder {
+    Ast &ast;
+
+    uint32_t add(Kind kind, lexer::TokenType op = lexer::TokenType::ILLEGAL){
+        ast.nodes.push_back(Node{kind, op});
+        return ast.nodes.size() - 1;
+    }
+
+    // children are flattened first, so a list stays contiguous in lists
+    template <typename T>
+    uint32_t list(const std::vector<parser::NodePtr<T>> &children){
+        std::vector<uint32_t> indices;
+        indices.reserve(children.size());
+        for(auto &child : children){
+            indices.push_back(build(child.get()));
+        }
+        uint32_t start = ast.lists.size();
+        ast.lists.insert(ast.lists.end(), indices.begin(), indices.end());
+        return start;
+    }
+
+    // pre-order: a node comes right before its children in the array
+    uint32_t build(const parser::Node *node){
+        if(node == nullptr){
+            return NONE;
+        }
+        if(auto p = dynamic_cast<const parser::Program*>(node)){
+            uint32_t i = add(Kind::PROGRAM);
+            uint32_t start = list(p->statements);
+            ast.nodes[i].a = start;
+            ast.nodes[i].b = p->statements.size();
+            return i;
+        }else if(auto p = dynamic_cast<const parser::BlockStatement*>(node)){
+            uint32_t i = add(Kind::BLOCK);
+            uint32_t start = list(p->statements);
+            ast.nodes[i].a = start;
+            ast.nodes[i].b = p->statements.size();
+            return i;
+        }else if(auto p = dynamic_cast<const parser::LetStatement*>(node)){
+            uint32_t i = add(Kind::LET);
+            ast.nodes[i].a = p->name->sym;
+            ast.nodes[i].c = p->name->slot;
+            uint32_t value = build(p->value.get());
+            ast.nodes[i].b = value;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::ReturnStatement*>(node)){
+            uint32_t i = add(Kind::RETURN);
+            uint32_t value = build(p->return_value.get());
+            ast.nodes[i].a = value;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::ExpressionStatement*>(node)){
+            uint32_t i = add(Kind::EXPRESSION);
+            uint32_t expr = build(p->expr.get());
+            ast.nodes[i].a = expr;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::Identifier*>(node)){
+            uint32_t i = add(Kind::IDENTIFIER);
+            ast.nodes[i].a = p->sym;
+            ast.nodes[i].b = p->depth;
+            ast.nodes[i].c = p->slot;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::IntegerLiteral*>(node)){
+            uint32_t i = add(Kind::INTEGER);
+            ast.ints.push_back(p->val);
+            ast.nodes[i].a = ast.ints.size() - 1;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::Boolean*>(node)){
+            uint32_t i = add(Kind::BOOLEAN);
+            ast.nodes[i].a = p->val;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::PrefixExpression*>(node)){
+            uint32_t i = add(Kind::PREFIX, p->op);
+            uint32_t right = build(p->right.get());
+            ast.nodes[i].a = right;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::InfixExpression*>(node)){
+            uint32_t i = add(Kind::INFIX, p->op);
+            uint32_t left = build(p->left.get());
+            uint32_t right = build(p->right.get());
+            ast.nodes[i].a = left;
+            ast.nodes[i].b = right;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::IfExpression*>(node)){
+            uint32_t i = add(Kind::IF);
+            uint32_t cond = build(p->cond.get());
+            uint32_t consequence = build(p->consequence.get());
+            uint32_t alternative = build(p->alternative.get());
+            ast.nodes[i].a = cond;
+            ast.nodes[i].b = consequence;
+            ast.nodes[i].c = alternative;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::FunctionLiteral*>(node)){
+            // the flat tree is built in full, including lazily skipped bodies
+            p->parse_body();
+            uint32_t i = add(Kind::FUNCTION);
+            // parameters are identifiers and add nothing to lists, so the
+            // frame size stays right before them
+            uint32_t start = ast.lists.size();
+            ast.lists.push_back(p->frame_size);
+            list(p->parameters);
+            uint32_t body = build(p->body.get());
+            ast.nodes[i].a = start;
+            ast.nodes[i].b = p->parameters.size();
+            ast.nodes[i].c = body;
+            return i;
+        }else if(auto p = dynamic_cast<const parser::CallExpression*>(node)){
+            uint32_t i = add(Kind::CALL);
+            uint32_t function = build(p->function.get());
+            uint32_t start = list(p->arguments);
+            ast.nodes[i].a = function;
+            ast.nodes[i].b = start;
+            ast.nodes[i].c = p->arguments.size();
+            return i;
+        }
+        return NONE;
+    }
+};
+
+}
+
+std::shared_ptr<const Ast> flatten(const parser::Program &program){
+    auto ast = std::make_shared<Ast>();
+    Builder builder{*ast};
+    ast->root = builder.build(&program);
+    return ast;
+}
+
+std::string string(const Ast &ast, uint32_t index){
+    if(index == NONE){
+        return "";
+    }
+    const Node &node = ast.nodes[index];
+    std::string out;
+    switch(node.kind){
+        case Kind::PROGRAM:
+            for(uint32_t i = 0; i < node.b; i++){
+                out += string(ast, ast.lists[node.a + i]);
+            }
+            return out;
+        case Kind::BLOCK:
+            out = "{\n";
+            for(uint32_t i = 0; i < node.b; i++){
+                out += string(ast, ast.lists[node.a + i]) + "\n";
+            }
+            return out + "}";
+        case Kind::LET:
+            return "let " + lexer::symbol_name(node.a) + " = " + string(ast, node.b) + ";";
+        case Kind::RETURN:
+            return "return " + string(ast, node.a) + ";";
+        case Kind::EXPRESSION:
+            return string(ast, node.a);
+        case Kind::IDENTIFIER:
+            return lexer::symbol_name(node.a);
+        case Kind::INTEGER:
+            return fmt::to_string(ast.ints[node.a]);
+        case Kind::BOOLEAN:
+            return node.a ? "true" : "false";
+        case Kind::PREFIX:
+            out = lexer::token_spelling(node.op);
+            return "(" + out + string(ast, node.a) + ")";
+        case Kind::INFIX:
+            out = lexer::token_spelling(node.op);
+            return "(" + string(ast, node.a) + " " + out + " " + string(ast, node.b) + ")";
+        case Kind::IF:
+            return "if" + string(ast, node.a) + " " + string(ast, node.b) +
+                string(ast, node.c);
+        case Kind::FUNCTION:
+            out = "fn(";
+            for(uint32_t i = 0; i < node.b; i++){
+                out += string(ast, ast.lists[node.a + 1 + i]);
+                if(i + 1 < node.b){
+                    out += ", ";
+                }
+            }
+            return out + "){\n" + string(ast, node.c) + "\n}";
+        case Kind::CALL:
+            out = string(ast, node.a) + "(";
+            for(uint32_t i = 0; i < node.c; i++){
+                out += string(ast, ast.lists[node.b + i]);
+                if(i + 1 < node.c){
+                    out += ", ";
+                }
+            }
+            return out + ")";
+    }
+    return out;
+}
+
+std::string Function::inspect() const {
+    return string(*ast, node);
+}
+
+void Function::trace(gc::Tracer &tracer) const {
+    if(environment){
+        tracer.visit(environment.get());
+    }
+}
+
+void Function::clear(){
+    environment = nullptr;
+}
+
+// mirrors eval::eval node for node, so both evaluators give the same results
+object::Value eval(const std::shared_ptr<const Ast> &ast, uint32_t index,
+    const object::Ref<object::Environment> &environment){
+    if(index == NONE){
+        return object::Value();
+    }
+    const Node &node = ast->nodes[index];
+    switch(node.kind){
+        case Kind::PROGRAM: {
+            object::Value result;
+            for(uint32_t i = 0; i < node.b; i++){
+                gc::safepoint();
+                result = eval(ast, ast->lists[node.a + i], environment);
+                if(result.returning){
+                    result.returning = false;
+                    return result;
+                }
+                if(eval::is_error(result)){
+                    return result;
+                }
+            }
+            return result;
+        }
+        case Kind::BLOCK: {
+            object::Value result;
+            for(uint32_t i = 0; i < node.b; i++){
+                gc::safepoint();
+                result = eval(ast, ast->lists[node.a + i], environment);
+                if(result.returning || eval::is_error(result)){
+                    return result;
+                }
+            }
+            return result;
+        }
+        case Kind::LET: {
+            auto val = eval(ast, node.b, environment);
+            if(eval::is_error(val)){
+                return val;
+            }
+            environment->set(node.c, std::move(val));
+            return object::Value();
+        }
+        case Kind::RETURN: {
+            auto val = eval(ast, node.a, environment);
+            if(eval::is_error(val)){
+                return val;
+            }
+            val.returning = true;
+            return val;
+        }
+        case Kind::EXPRESSION:
+            return eval(ast, node.a, environment);
+        case Kind::IDENTIFIER: {
+            auto [val, ok] = environment->get(node.b, node.c);
+            if(!ok){
+                return eval::new_error(fmt::format("identifier not found: {}",
+                    lexer::symbol_name(node.a)));
+            }
+            return std::move(val);
+        }
+        case Kind::INTEGER:
+            return object::Value::from_int(ast->ints[node.a]);
+        case Kind::BOOLEAN:
+            return object::Value::from_bool(node.a != 0);
+        case Kind::PREFIX: {
+            auto right = eval(ast, node.a, environment);
+            if(eval::is_error(right)){
+                return right;
+            }
+            return eval::eval_prefix_expression(node.op, std::move(right));
+        }
+        case Kind::INFIX: {
+            auto left = eval(ast, node.a, environment);
+            if(eval::is_error(left)){
+                return left;
+            }
+            auto right = eval(ast, node.b, environment);
+            if(eval::is_error(right)){
+                return right;
+            }
+            return eval::eval_infix_expression(node.op, std::move(left),
+                std::move(right));
+        }
+        case Kind::IF: {
+            auto cond = eval(ast, node.a, environment);
+            if(eval::is_error(cond)){
+                return cond;
+            }
+            if(eval::is_truthy(cond)){
+                return eval(ast, node.b, environment);
+            }else if(node.c != NONE){
+                return eval(ast, node.c, environment);
+            }
+            return object::Value::null();
+        }
+        case Kind::FUNCTION:
+            return object::Value::make<Function>(ast, index, environment);
+        case Kind::CALL: {
+            auto function = eval(ast, node.a, environment);
+            if(eval::is_error(function)){
+                return function;
+            }
+            std::vector<object::Value> args;
+            for(uint32_t i = 0; i < node.c; i++){
+                auto arg = eval(ast, ast->lists[node.b + i], environment);
+                if(eval::is_error(arg)){
+                    return arg;
+                }
+                args.push_back(std::move(arg));
+            }
+            auto fn = function.as<Function>();
+            if(fn == nullptr){
+                return eval::new_error(fmt::format("not a function: {}", function.type()));
+            }
+            const Node &literal = fn->ast->nodes[fn->node];
+            if(args.size() != literal.b){
+                return eval::new_error(fmt::format(
+                    "wrong number of arguments: want={}, got={}", literal.b, args.size()));
+            }
+            auto env = object::new_enclosed_environment(fn->environment,
+                fn->ast->lists[literal.a]);
+            for(uint32_t i = 0; i < literal.b; i++){
+                const Node &param = fn->ast->nodes[fn->ast->lists[literal.a + 1 + i]];
+                env->set(param.c, std::move(args[i]));
+            }
+            auto result = eval(fn->ast, literal.c, env);
+            result.returning = false;
+            return result;
+        }
+    }
+    return object::Value();
+}
+
+void test_flatten(){
+    std::vector<std::string> inputs = {
+        "let x = 5; return x;",
+        "-a * b + !c",
+        "a + b * c + d / e - f == 3 > 5",
+        "if (x < y) { x } else { y }",
+        "let add = fn(x, y) { x + y; }; add(1, 2 * 3, add(4, 5))",
+        "fn() { return true; }",
+    };
+    int passed = 0;
+    for(auto &input : inputs){
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        auto ast = flatten(*program);
+        auto expected = program->string();
+        auto got = string(*ast, ast->root);
+        if(got != expected){
+            printf("[error] flat string mismatch: expected %s, got %s\n",
+                expected.c_str(), got.c_str());
+            continue;
+        }
+        if(ast->nodes[ast->root].kind != Kind::PROGRAM){
+            printf("[error] flat root is not a program\n");
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, inputs.size());
+}
+
+void test_eval_flat(){
+    std::vector<std::string> inputs = {
+        "5",
+        "(5 + 10 * 2 + 15 / 3) * 2 + -10",
+        "!true == false",
+        "let a = 5; let b = a * 2; a + b",
+        "if (1 > 2) { 10 } else { 20 }",
+        "if (false) { 10 }",
+        "return 7; 9",
+        "5 + true",
+        "foobar",
+        "let id = fn(x) { x }; id(12)",
+        "fn(x) { x * 2 }",
+        "let f = fn(a, b) { a + b }; f(1)",
+        "let k = fn(a) { fn(b) { a + b } }; k(2)(3)",
+        "let fact = fn(n) { if (n < 2) { 1 } else { n * fact(n - 1) } }; fact(5)",
+    };
+    int passed = 0;
+    for(auto &input : inputs){
+        auto expected = eval::test_eval(input);
+
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        auto ast = flatten(*program);
+        auto environment = object::new_environment();
+        auto got = eval(ast, ast->root, environment);
+
+        std::string want = expected ? expected.inspect() : "nullptr";
+        std::string have = got ? got.inspect() : "nullptr";
+        if(want != have){
+            printf("[error] flat eval of %s: expected %s, got %s\n",
+                input.c_str(), want.c_str(), have.c_str());
+            continue;
+        }
+        passed++;
+    }
+
+    // a function outlives the program that defined it
+    auto environment = object::new_environment();
+    auto run = [&](const std::string &input){
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto ast = flatten(*p.parse_program());
+        return eval(ast, ast->root, environment);
+    };
+    run("let double = fn(x) { x * 2 };");
+    auto got = run("double(21)");
+    if(got && got.inspect() == "42"){
+        passed++;
+    }else{
+        printf("[error] flat eval of a function whose program is gone\n");
+    }
+    printf("[%d/%zu] test cases passed\n", passed, inputs.size() + 1);
+}
+
+}
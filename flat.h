@@ -0,0 +1,100 @@
+#ifndef FLAT_H
+#define FLAT_H
+
+// flat form of the AST: every node lives in one contiguous array and refers
+// to its children by 32-bit index, with literals and child lists in side
+// arrays and names as interned symbol ids. walking it touches memory in
+// order instead of following pointers across the heap. built from a parsed
+// Program with flatten()
+
+#include "object.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace flat {
+
+enum class Kind : uint8_t {
+    PROGRAM,
+    BLOCK,
+    LET,
+    RETURN,
+    EXPRESSION,
+    IDENTIFIER,
+    INTEGER,
+    BOOLEAN,
+    PREFIX,
+    INFIX,
+    IF,
+    FUNCTION,
+    CALL,
+};
+
+// marks a missing child, e.g. an if without else
+constexpr uint32_t NONE = UINT32_MAX;
+
+// what a, b and c hold for each kind:
+//   PROGRAM, BLOCK   a = first entry in lists, b = statement count
+//   LET              a = symbol, b = value, c = slot
+//   RETURN           a = value
+//   EXPRESSION       a = expression
+//   IDENTIFIER       a = symbol, b = depth, c = slot (see resolver.h)
+//   INTEGER          a = index in ints
+//   BOOLEAN          a = 0 or 1
+//   PREFIX           op, a = right
+//   INFIX            op, a = left, b = right
+//   IF               a = condition, b = consequence, c = alternative or NONE
+//   FUNCTION         a = first entry in lists: the frame size, then the
+//                    parameters; b = parameter count, c = body
+//   CALL             a = function, b = first entry in lists, c = argument count
+struct Node {
+    Kind kind;
+    lexer::TokenType op;
+    uint32_t a = NONE;
+    uint32_t b = NONE;
+    uint32_t c = NONE;
+};
+static_assert(sizeof(Node) == 16);
+
+struct Ast {
+    std::vector<Node> nodes;
+    std::vector<int64_t> ints;
+    // child indices of blocks, parameter lists and argument lists
+    std::vector<uint32_t> lists;
+    uint32_t root = NONE;
+};
+
+// shared, since the function values evaluating it creates keep it alive
+std::shared_ptr<const Ast> flatten(const parser::Program &program);
+// same text as parser::Node::string() for the node at index
+std::string string(const Ast &ast, uint32_t index);
+
+// function value created by the flat evaluator; the body stays in the Ast,
+// which the value holds, so it can outlive every other owner of the Ast
+struct Function : object::Object, pool::Pooled<Function> {
+    const std::shared_ptr<const Ast> ast;
+    const uint32_t node;
+    // only reset by clear()
+    object::Ref<object::Environment> environment;
+    object::Tag tag() const override { return object::Tag::FUNCTION; }
+    std::string inspect() const override;
+    void trace(gc::Tracer &tracer) const override;
+    void clear() override;
+
+    Function(std::shared_ptr<const Ast> ast, uint32_t node,
+        object::Ref<object::Environment> environment):
+        ast(std::move(ast)), node(node), environment(std::move(environment)) {
+        gc::track(this);
+    };
+};
+
+object::Value eval(const std::shared_ptr<const Ast> &ast, uint32_t index,
+    const object::Ref<object::Environment> &environment);
+
+void test_flatten();
+void test_eval_flat();
+
+}
+
+#endif
@@ -0,0 +1,294 @@
+#include "gc.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+namespace gc {
+
+Heap heap;
+
+namespace {
+
+void init(Cell &list){
+    list.prev = &list;
+    list.next = &list;
+}
+
+void link(Cell &list, Cell *cell){
+    cell->prev = &list;
+    cell->next = list.next;
+    list.next->prev = cell;
+    list.next = cell;
+}
+
+void unlink(Cell *cell){
+    cell->prev->next = cell->next;
+    cell->next->prev = cell->prev;
+    cell->prev = nullptr;
+    cell->next = nullptr;
+}
+
+// moves every cell of from to the front of to
+void splice(Cell &from, Cell &to){
+    if(from.next == &from){
+        return;
+    }
+    from.prev->next = to.next;
+    to.next->prev = from.prev;
+    to.next = from.next;
+    from.next->prev = &to;
+    init(from);
+}
+
+// takes one reference for each cell in the collection it points to
+struct Subtract : Tracer {
+    void visit(Cell *cell) override {
+        if(cell->generation == Generation::COLLECTING){
+            cell->external--;
+        }
+    }
+};
+
+struct Mark : Tracer {
+    std::vector<Cell*> stack;
+    void visit(Cell *cell) override {
+        if(cell->generation == Generation::COLLECTING){
+            cell->generation = Generation::REACHABLE;
+            stack.push_back(cell);
+        }
+    }
+};
+
+}
+
+Cell::~Cell(){
+    if(generation == Generation::YOUNG){
+        heap.young_count--;
+    }else if(generation == Generation::OLD){
+        heap.old_count--;
+    }
+    if(next != nullptr){
+        unlink(this);
+    }
+}
+
+Heap::Heap(){
+    init(young);
+    init(old);
+}
+
+void track(Cell *cell){
+    link(heap.young, cell);
+    cell->generation = Generation::YOUNG;
+    heap.young_count++;
+}
+
+void collect(bool full){
+    auto start = std::chrono::steady_clock::now();
+    if(full){
+        splice(heap.young, heap.old);
+    }
+    Cell &list = full ? heap.old : heap.young;
+
+    for(Cell *c = list.next; c != &list; c = c->next){
+        c->generation = Generation::COLLECTING;
+        c->external = c->refs;
+    }
+    Subtract subtract;
+    for(Cell *c = list.next; c != &list; c = c->next){
+        c->trace(subtract);
+    }
+    // whatever is still referenced from outside the collection is a root
+    Mark mark;
+    for(Cell *c = list.next; c != &list; c = c->next){
+        if(c->generation != Generation::COLLECTING || c->external <= 0){
+            continue;
+        }
+        c->generation = Generation::REACHABLE;
+        mark.stack.push_back(c);
+        while(!mark.stack.empty()){
+            Cell *top = mark.stack.back();
+            mark.stack.pop_back();
+            top->trace(mark);
+        }
+    }
+
+    std::vector<Cell*> garbage;
+    size_t kept = 0, promoted = 0;
+    for(Cell *c = list.next; c != &list;){
+        Cell *next = c->next;
+        if(c->generation != Generation::REACHABLE){
+            unlink(c);
+            c->generation = Generation::NONE;
+            garbage.push_back(c);
+        }else if(full){
+            c->generation = Generation::OLD;
+            kept++;
+        }else if(c->survived){
+            unlink(c);
+            link(heap.old, c);
+            c->generation = Generation::OLD;
+            promoted++;
+        }else{
+            c->generation = Generation::YOUNG;
+            c->survived = true;
+            kept++;
+        }
+        c = next;
+    }
+    if(full){
+        heap.young_count = 0;
+        heap.old_count = heap.old_survivors = kept;
+        heap.stats.old_collections++;
+    }else{
+        heap.young_count = kept;
+        heap.old_count += promoted;
+        heap.stats.promoted += promoted;
+        heap.stats.young_collections++;
+    }
+
+    // hold every garbage cell while the cycles are cut, so none is freed
+    // while another still points to it
+    for(Cell *c : garbage){
+        c->refs++;
+    }
+    for(Cell *c : garbage){
+        c->clear();
+    }
+    for(Cell *c : garbage){
+        if(--c->refs == 0){
+            delete c;
+        }
+    }
+    heap.stats.freed += garbage.size();
+
+    uint64_t pause = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    heap.stats.pause_ns += pause;
+    heap.stats.max_pause_ns = std::max(heap.stats.max_pause_ns, pause);
+}
+
+void print_stats(FILE *out){
+    const Stats &s = heap.stats;
+    fprintf(out, "gc: %llu young and %llu old collections, %llu cells freed, "
+        "%llu promoted, pauses %.3f ms total and %.3f ms max, "
+        "%zu young and %zu old cells live\n",
+        (unsigned long long)s.young_collections, (unsigned long long)s.old_collections,
+        (unsigned long long)s.freed, (unsigned long long)s.promoted,
+        s.pause_ns / 1e6, s.max_pause_ns / 1e6, heap.young_count, heap.old_count);
+}
+
+namespace {
+
+struct TestCell : Cell {
+    static inline int live = 0;
+    std::vector<Cell*> children;
+
+    TestCell(){
+        live++;
+        track(this);
+    }
+    ~TestCell(){
+        clear();
+        live--;
+    }
+    void point_to(Cell *cell){
+        cell->refs++;
+        children.push_back(cell);
+    }
+    void trace(Tracer &tracer) const override {
+        for(Cell *c : children){
+            tracer.visit(c);
+        }
+    }
+    void clear() override {
+        auto dropped = std::move(children);
+        children.clear();
+        for(Cell *c : dropped){
+            if(--c->refs == 0){
+                delete c;
+            }
+        }
+    }
+};
+
+// a reference from outside the heap, like a local in the evaluator
+void drop(Cell *cell){
+    if(--cell->refs == 0){
+        delete cell;
+    }
+}
+
+}
+
+void test_collect(){
+    int passed = 0, total = 0;
+    auto check = [&](bool ok, const char *what){
+        total++;
+        if(ok){
+            passed++;
+        }else{
+            printf("[error] %s\n", what);
+        }
+    };
+    // drop whatever earlier tests left behind
+    collect(true);
+    int live = TestCell::live;
+    Stats before = heap.stats;
+
+    {
+        auto a = new TestCell(), b = new TestCell();
+        a->refs++;
+        a->point_to(b);
+        b->point_to(a);
+        drop(a);
+        check(TestCell::live == live + 2, "reference counts freed a cycle");
+        collect();
+        check(TestCell::live == live, "young collection kept an unreachable cycle");
+    }
+    {
+        auto self = new TestCell();
+        self->refs++;
+        self->point_to(self);
+        drop(self);
+        collect();
+        check(TestCell::live == live, "young collection kept a cell pointing to itself");
+    }
+    {
+        // reachable from a local, so it survives and is promoted
+        auto a = new TestCell(), b = new TestCell();
+        a->refs++;
+        a->point_to(b);
+        b->point_to(a);
+        collect();
+        check(TestCell::live == live + 2, "young collection freed a reachable cycle");
+        check(a->generation == Generation::YOUNG && a->survived,
+            "promoted on the first survival");
+        collect();
+        check(a->generation == Generation::OLD && b->generation == Generation::OLD,
+            "survivors were not promoted");
+
+        // a young cell only the old cycle knows about
+        auto c = new TestCell();
+        c->refs++;
+        a->point_to(c);
+        drop(c);
+        collect();
+        check(TestCell::live == live + 3, "young collection freed a cell held by an old one");
+
+        drop(a);
+        collect();
+        check(TestCell::live == live + 3, "young collection freed old cells");
+        collect(true);
+        check(TestCell::live == live, "full collection kept an unreachable cycle");
+    }
+    check(heap.stats.young_collections - before.young_collections == 6 &&
+        heap.stats.old_collections - before.old_collections == 1, "collections not counted");
+    check(heap.stats.freed - before.freed == 6, "freed cells not counted");
+
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+}
@@ -0,0 +1,125 @@
+#ifndef GC_H
+#define GC_H
+
+// cycle collector for the object heap. objects and environments are freed
+// by their reference counts as soon as the last reference goes away; the
+// collector only has to find groups of them that keep each other alive,
+// e.g. an environment holding a closure that holds the environment.
+//
+// cells that can refer to other cells are tracked in one of two
+// generations. a new cell starts young and is promoted to the old one when
+// it survives its second collection of the young generation; the first
+// one often runs while the call that made it is still on the stack. the
+// old generation is collected together with the young one once it has
+// grown by Config::old_growth since its last collection.
+//
+// a collection is precise. it counts, for every cell it collects, the
+// references held by the other tracked cells. a cell with more references
+// than that is referenced from outside: the environment chain of a running
+// evaluator or a value on the stack. those are the roots, and everything
+// not reachable from them is garbage and is broken up with Cell::clear.
+// collections only run at safepoint(), which the evaluators call between
+// statements, so a cell under construction is never seen
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+namespace gc {
+
+struct Cell;
+
+// receives every cell a cell refers to
+struct Tracer {
+    virtual void visit(Cell *cell) = 0;
+};
+
+enum class Generation : uint8_t {
+    // not tracked: a leaf like an error, or already found to be garbage
+    NONE,
+    YOUNG,
+    OLD,
+    // scratch states of a collection in progress
+    COLLECTING,
+    REACHABLE,
+};
+
+// header shared by everything on the object heap. refs is the reference
+// count; see object::retain and object::release
+struct Cell {
+    mutable uint32_t refs = 0;
+    Generation generation = Generation::NONE;
+    // young and already survived one collection
+    bool survived = false;
+    // refs not accounted for by other cells, during a collection
+    int32_t external = 0;
+    Cell *prev = nullptr;
+    Cell *next = nullptr;
+
+    // call tracer.visit on every cell this one holds a counted reference to
+    virtual void trace(Tracer &) const {}
+    // drop every reference to other cells, to break a garbage cycle
+    virtual void clear() {}
+    virtual ~Cell();
+};
+
+struct Config {
+    // a young collection runs once this many cells are young. 0 turns
+    // collection off
+    size_t young_limit = 4096;
+    // an old collection runs once the old generation is this many times
+    // the size it had after the last one
+    double old_growth = 2.0;
+};
+
+struct Stats {
+    uint64_t young_collections = 0;
+    uint64_t old_collections = 0;
+    uint64_t promoted = 0;
+    uint64_t freed = 0;
+    uint64_t pause_ns = 0;
+    uint64_t max_pause_ns = 0;
+};
+
+struct Heap {
+    Config config;
+    Stats stats;
+    Cell young;
+    Cell old;
+    size_t young_count = 0;
+    size_t old_count = 0;
+    // old_count after the last old collection
+    size_t old_survivors = 0;
+
+    Heap();
+    // old_count that triggers the next old collection
+    size_t old_limit() const {
+        size_t grown = (size_t)(old_survivors * config.old_growth);
+        return grown > config.young_limit ? grown : config.young_limit;
+    }
+};
+
+// one heap per process; like the reference counts it is not thread safe
+extern Heap heap;
+
+// links a new cell into the young generation. called by the constructors
+// of cells that can refer to others
+void track(Cell *cell);
+// collects the young generation, or both with full
+void collect(bool full = false);
+
+// cheap enough to call between any two statements
+inline void safepoint(){
+    if(heap.young_count >= heap.config.young_limit && heap.config.young_limit != 0){
+        collect(heap.old_count >= heap.old_limit());
+    }
+}
+
+// one line summary of heap.stats and the generation sizes
+void print_stats(FILE *out);
+
+void test_collect();
+
+}
+
+#endif
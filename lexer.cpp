@@ -1,71 +1,267 @@
 #include "lexer.h"
+#include "scan.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 #include <vector>
+#include <cstring>
 #include <ctype.h>
 #include <cstdio>
 #include <cctype>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace std;
 
 namespace lexer {
 
-unordered_map<TokenType, string> enum_to_string_map = {
-    {TokenType::ILLEGAL, "ILLEGAL"},
-    {TokenType::ENDOF, "ENDOF"},
-    {TokenType::ID, "ID"},
-    {TokenType::INT, "INT"},
-    {TokenType::ASSIGN, "ASSIGN"},
-    {TokenType::PLUS, "PLUS"},
-    {TokenType::MINUS, "MINUS"},
-    {TokenType::BANG, "BANG"},
-    {TokenType::ASTERISK, "ASTERISK"},
-    {TokenType::FSLASH, "FSLASH"},
-    {TokenType::LT, "LT"},
-    {TokenType::GT, "GT"},
-    {TokenType::EQ, "EQ"},
-    {TokenType::NEQ, "NEQ"},
-    {TokenType::COMMA, "COMMA"},
-    {TokenType::SEMICOLON, "SEMICOLON"},
-    {TokenType::LPAREN, "LPAREN"},
-    {TokenType::RPAREN, "RPAREN"},
-    {TokenType::LBRAC, "LBRAC"},
-    {TokenType::RBRAC, "RBRAC"},
-    {TokenType::FUNCTION, "FUNCTION"},
-    {TokenType::LET, "LET"},
-    {TokenType::TRUE, "TRUE"},
-    {TokenType::FALSE, "FALSE"},
-    {TokenType::IF, "IF"},
-    {TokenType::ELSE, "ELSE"},
-    {TokenType::RETURN, "RETURN"},
+namespace {
+
+struct TokenDef {
+    TokenType type;
+    const char *name;
+    const char *spelling;
+    bool keyword;
+};
+
+#define LEXER_DEF_TOKEN(name) {TokenType::name, #name, nullptr, false},
+#define LEXER_DEF_PUNCT(name, spelling) {TokenType::name, #name, spelling, false},
+#define LEXER_DEF_KEYWORD(name, spelling) {TokenType::name, #name, spelling, true},
+constexpr TokenDef token_defs[] = {
+    LEXER_TOKENS(LEXER_DEF_TOKEN, LEXER_DEF_PUNCT, LEXER_DEF_KEYWORD)
+};
+#undef LEXER_DEF_TOKEN
+#undef LEXER_DEF_PUNCT
+#undef LEXER_DEF_KEYWORD
+
+static_assert(sizeof(token_defs) / sizeof(token_defs[0]) == TOKEN_COUNT);
+
+constexpr size_t length(const char *s){
+    size_t n = 0;
+    while(s[n] != '\0') n++;
+    return n;
+}
+
+// character classes. every character used in a PUNCT spelling gets a
+// class of its own after the fixed ones
+enum CharClass : uint8_t {
+    CC_OTHER,
+    CC_SPACE,
+    CC_ALPHA,
+    CC_DIGIT,
+    CC_END,
+    CC_FIRST_PUNCT
+};
+
+// DFA states. S_STOP means there is no transition, the trie of PUNCT
+// spellings starts at S_FIRST_PUNCT
+enum State : uint8_t {
+    S_STOP,
+    S_START,
+    S_ID,
+    S_INT,
+    S_FIRST_PUNCT
+};
+
+constexpr size_t count_classes(){
+    bool seen[256] = {};
+    size_t n = CC_FIRST_PUNCT;
+    for(const TokenDef &def : token_defs){
+        if(def.spelling == nullptr || def.keyword) continue;
+        for(const char *c = def.spelling; *c; c++){
+            if(!seen[(unsigned char)*c]){
+                seen[(unsigned char)*c] = true;
+                n++;
+            }
+        }
+    }
+    return n;
+}
+
+constexpr size_t count_states(){
+    // one state per distinct spelling prefix, every prefix is a PUNCT
+    size_t n = S_FIRST_PUNCT;
+    for(const TokenDef &def : token_defs){
+        if(def.spelling != nullptr && !def.keyword) n++;
+    }
+    return n;
+}
+
+constexpr size_t N_CLASSES = count_classes();
+constexpr size_t N_STATES = count_states();
+static_assert(N_STATES < 256);
+
+struct DfaTables {
+    uint8_t char_class[256];
+    uint8_t next[N_STATES][N_CLASSES];
+    TokenType accept[N_STATES];
 };
 
-unordered_map<string, TokenType> keywords = {
-    {"let", TokenType::LET},
-    {"fn", TokenType::FUNCTION},
-    {"true", TokenType::TRUE},
-    {"false", TokenType::FALSE},
-    {"if", TokenType::IF},
-    {"else", TokenType::ELSE},
-    {"return", TokenType::RETURN}
+constexpr DfaTables build_dfa(){
+    DfaTables t = {};
+    for(int c = 0; c < 256; c++){
+        t.char_class[c] = CC_OTHER;
+    }
+    for(char c : {' ', '\t', '\n', '\r'}) t.char_class[(unsigned char)c] = CC_SPACE;
+    for(int c = 'a'; c <= 'z'; c++) t.char_class[c] = CC_ALPHA;
+    for(int c = 'A'; c <= 'Z'; c++) t.char_class[c] = CC_ALPHA;
+    for(int c = '0'; c <= '9'; c++) t.char_class[c] = CC_DIGIT;
+    t.char_class[0] = CC_END;
+
+    for(size_t s = 0; s < N_STATES; s++){
+        t.accept[s] = TokenType::ILLEGAL;
+    }
+    t.next[S_START][CC_ALPHA] = S_ID;
+    t.next[S_ID][CC_ALPHA] = S_ID;
+    t.accept[S_ID] = TokenType::ID;
+    t.next[S_START][CC_DIGIT] = S_INT;
+    t.next[S_INT][CC_DIGIT] = S_INT;
+    t.accept[S_INT] = TokenType::INT;
+
+    uint8_t n_classes = CC_FIRST_PUNCT;
+    uint8_t n_states = S_FIRST_PUNCT;
+    for(const TokenDef &def : token_defs){
+        if(def.spelling == nullptr || def.keyword) continue;
+        uint8_t state = S_START;
+        for(const char *c = def.spelling; *c; c++){
+            uint8_t &cls = t.char_class[(unsigned char)*c];
+            if(cls == CC_OTHER){
+                cls = n_classes++;
+            }
+            if(t.next[state][cls] == S_STOP){
+                t.next[state][cls] = n_states++;
+            }
+            state = t.next[state][cls];
+        }
+        t.accept[state] = def.type;
+    }
+    return t;
+}
+
+constexpr DfaTables dfa = build_dfa();
+
+// keywords are found with a perfect hash over (first char, last char,
+// length). the multiplier is searched for at compile time
+constexpr size_t KEYWORD_SLOTS = 16;
+
+constexpr uint32_t keyword_hash(const char *s, size_t n, uint32_t seed){
+    uint32_t key = ((uint32_t)(unsigned char)s[0] << 16) |
+        ((uint32_t)(unsigned char)s[n - 1] << 8) | (uint32_t)n;
+    return (key * seed) >> 28;
+}
+
+constexpr uint32_t find_keyword_seed(){
+    for(uint32_t seed = 1; seed < 1000000; seed += 2){
+        bool used[KEYWORD_SLOTS] = {};
+        bool ok = true;
+        for(const TokenDef &def : token_defs){
+            if(!def.keyword) continue;
+            uint32_t h = keyword_hash(def.spelling, length(def.spelling), seed);
+            if(used[h]){
+                ok = false;
+                break;
+            }
+            used[h] = true;
+        }
+        if(ok) return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t KEYWORD_SEED = find_keyword_seed();
+static_assert(KEYWORD_SEED != 0, "no perfect hash for the keyword list");
+
+struct KeywordSlot {
+    const char *spelling;
+    size_t len;
+    TokenType type;
 };
 
+constexpr auto build_keyword_table(){
+    std::array<KeywordSlot, KEYWORD_SLOTS> table = {};
+    for(const TokenDef &def : token_defs){
+        if(!def.keyword) continue;
+        size_t n = length(def.spelling);
+        table[keyword_hash(def.spelling, n, KEYWORD_SEED)] = {def.spelling, n, def.type};
+    }
+    return table;
+}
+
+constexpr auto keyword_table = build_keyword_table();
+
+}
+
 string enum_to_string(TokenType t){
-    return enum_to_string_map[t];
+    return token_defs[t].name;
+}
+
+string_view token_spelling(TokenType t){
+    return token_defs[t].spelling ? token_defs[t].spelling : "";
+}
+
+namespace {
+
+// names live in a deque so the string_view keys stay valid as it grows
+struct SymbolTable {
+    mutex lock;
+    deque<string> names;
+    unordered_map<string_view, uint32_t> ids;
+};
+
+SymbolTable &symbols(){
+    static SymbolTable table;
+    return table;
+}
+
 }
 
-TokenType lookup_id(string id){
-    if(keywords.find(id) != keywords.end()){
-        return keywords[id];
+uint32_t intern(string_view name){
+    SymbolTable &table = symbols();
+    lock_guard guard(table.lock);
+    auto it = table.ids.find(name);
+    if(it != table.ids.end()){
+        return it->second;
+    }
+    uint32_t sym = table.names.size();
+    table.names.emplace_back(name);
+    table.ids.emplace(table.names.back(), sym);
+    return sym;
+}
+
+const string &symbol_name(uint32_t sym){
+    SymbolTable &table = symbols();
+    lock_guard guard(table.lock);
+    return table.names[sym];
+}
+
+TokenType lookup_id(string_view id){
+    const KeywordSlot &slot = keyword_table[keyword_hash(id.data(), id.size(), KEYWORD_SEED)];
+    if(slot.len == id.size() && memcmp(slot.spelling, id.data(), id.size()) == 0){
+        return slot.type;
     }
     return TokenType::ID;
 }
 
 void Lexer::_skip_whitespace(){
-    while(ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r')
-        _read_char();
+    if(ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r'){
+        _seek(scan::skip_whitespace(input.data() + position, 
+            input.data() + input.size()) - input.data());
+    }
     return;
 }
 
+void Lexer::_seek(int pos){
+    read_position = pos;
+    _read_char();
+}
+
 char Lexer::_peek_char(){
     if(read_position >= input.size()){
         return '\0';
@@ -85,77 +281,299 @@ void Lexer::_read_char(){
     return;
 }
 
-string Lexer::_read_number(){
-    int start_pos = position;
-    while(isdigit(ch)){
-        _read_char();
-    }
-    int end_pos = position-1;
-    return input.substr(start_pos, end_pos - start_pos+1);
+Token Lexer::next_token(){
+    return Token(next_token_view());
 }
 
-string Lexer::_read_identifier(){
-    int start_pos = position;
-    while(isalpha(ch)){
-        _read_char();
+// runs the DFA over one token starting at p, whitespace already skipped.
+// when at_eof is false and the token might continue past end, need_more
+// is set and the caller has to supply more input first
+struct ScanResult {
+    TokenType type;
+    const char *end;
+    bool need_more;
+};
+
+ScanResult scan_token(const char *p, const char *end, bool at_eof){
+    const char *start = p;
+    uint8_t state = S_START;
+    while(true){
+        if(p == end && !at_eof){
+            return ScanResult{TokenType::ILLEGAL, p, true};
+        }
+        uint8_t cls = (p < end) ? dfa.char_class[(unsigned char)*p] : (uint8_t)CC_END;
+        uint8_t next = dfa.next[state][cls];
+        if(next == S_STOP){
+            break;
+        }
+        state = next;
+        p++;
+        if(state == S_ID){
+            p = scan::skip_alpha(p, end);
+        }else if(state == S_INT){
+            p = scan::skip_digits(p, end);
+        }
+    }
+
+    if(state == S_START){
+        if(p >= end || *p == '\0'){
+            return ScanResult{TokenType::ENDOF, p, false};
+        }
+        // no token starts with this character
+        return ScanResult{TokenType::ILLEGAL, p + 1, false};
+    }
+    TokenType type = dfa.accept[state];
+    if(type == TokenType::ID){
+        type = lookup_id(string_view(start, p - start));
     }
-    int end_pos = position-1;
-    return input.substr(start_pos, end_pos-start_pos+1); 
+    return ScanResult{type, p, false};
 }
 
-Token Lexer::next_token(){
+TokenView Lexer::next_token_view(){
     _skip_whitespace();
-    Token tok;
-    switch (ch) {
-        case '=' : {
-            if(_peek_char() == '='){
-                _read_char();
-                tok = Token(TokenType::EQ, "==");
-            }else{
-                tok = Token(TokenType::ASSIGN, string(1, ch));
+    const char *begin = input.data();
+    const char *p = begin + position;
+    ScanResult r = scan_token(p, begin + input.size(), true);
+    if(r.type == TokenType::ENDOF){
+        return TokenView{TokenType::ENDOF, ""};
+    }
+    _seek(r.end - begin);
+    return TokenView{r.type, string_view(p, r.end - p)};
+}
+
+StreamLexer::StreamLexer(istream &in, size_t capacity) : in(&in), buffer(capacity) {}
+
+StreamLexer::StreamLexer(int fd, size_t capacity) : fd(fd), buffer(capacity) {}
+
+void StreamLexer::_refill(){
+    // slide the unread bytes (a partial token at most) to the front
+    if(begin > 0){
+        memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+    // a single token longer than the whole window
+    if(end == buffer.size()){
+        buffer.resize(buffer.size() * 2);
+    }
+    size_t want = buffer.size() - end;
+    size_t got = 0;
+    if(in != nullptr){
+        in->read(buffer.data() + end, want);
+        got = in->gcount();
+    }else{
+        ssize_t n = read(fd, buffer.data() + end, want);
+        got = (n > 0) ? n : 0;
+    }
+    end += got;
+    if(got == 0){
+        eof = true;
+    }
+}
+
+Token StreamLexer::next_token(){
+    while(true){
+        const char *data = buffer.data();
+        const char *p = scan::skip_whitespace(data + begin, data + end);
+        begin = p - data;
+        if(p == data + end && !eof){
+            _refill();
+            continue;
+        }
+        ScanResult r = scan_token(p, data + end, eof);
+        if(r.need_more){
+            _refill();
+            continue;
+        }
+        if(r.type == TokenType::ENDOF){
+            return Token(TokenType::ENDOF, "");
+        }
+        begin = r.end - data;
+        return Token(TokenView{r.type, string_view(p, r.end - p)});
+    }
+}
+
+TokenType TokenBuffer::type(size_t i) const {
+    if(i >= types.size()){
+        return TokenType::ENDOF;
+    }
+    return static_cast<TokenType>(types[i]);
+}
+
+string_view TokenBuffer::lexeme(size_t i) const {
+    if(i >= types.size()){
+        return "";
+    }
+    return source.substr(offsets[i], lengths[i]);
+}
+
+pair<int, int> TokenBuffer::location(size_t i) const {
+    if(line_starts.empty()){
+        line_starts.push_back(0);
+        const char *begin = source.data();
+        const char *end = begin + source.size();
+        for(const char *p = begin; p < end; p++){
+            p = static_cast<const char*>(memchr(p, '\n', end - p));
+            if(p == nullptr){
+                break;
             }
+            line_starts.push_back(p - begin + 1);
+        }
+    }
+    uint32_t offset = (i < offsets.size()) ? offsets[i] : source.size();
+    auto it = upper_bound(line_starts.begin(), line_starts.end(), offset);
+    int row = it - line_starts.begin();
+    int col = offset - *(it - 1) + 1;
+    return make_pair(row, col);
+}
+
+TokenBuffer tokenize(Lexer &l){
+    TokenBuffer buf;
+    buf.source = l.input;
+    // rough guess of one token every four bytes, avoids most regrowth
+    size_t guess = (l.input.size() - l.position) / 4 + 1;
+    buf.types.reserve(guess);
+    buf.offsets.reserve(guess);
+    buf.lengths.reserve(guess);
+    while(true){
+        TokenView tok = l.next_token_view();
+        uint32_t offset = (tok.type == TokenType::ENDOF) ? 
+            l.input.size() : tok.val.data() - l.input.data();
+        buf.types.push_back(tok.type);
+        buf.offsets.push_back(offset);
+        buf.lengths.push_back(tok.val.size());
+        if(tok.type == TokenType::ENDOF){
             break;
-        } 
-        case ';' : {tok = Token(TokenType::SEMICOLON, string(1, ch)); break;} 
-        case '(' : {tok = Token(TokenType::LPAREN, string(1, ch)); break;}
-        case ')' : {tok = Token(TokenType::RPAREN, string(1, ch)); break;} 
-        case ',' : {tok = Token(TokenType::COMMA, string(1, ch)); break;} 
-        case '+' : {tok = Token(TokenType::PLUS, string(1, ch)); break;} 
-
-        case '-' : {tok = Token(TokenType::MINUS, string(1, ch)); break;} 
-        case '!' : {
-            if(_peek_char() == '='){
-                _read_char();
-                tok = Token(TokenType::NEQ, "!=");
-            }else{
-                tok = Token(TokenType::BANG, string(1, ch));
-            }
+        }
+    }
+    return buf;
+}
+
+TokenBuffer tokenize(string_view input){
+    Lexer l(input);
+    return tokenize(l);
+}
+
+// appends src to dst, dropping the ENDOF that closes src
+void append_tokens(TokenBuffer &dst, const TokenBuffer &src){
+    size_t n = src.size() - 1;
+    dst.types.insert(dst.types.end(), src.types.begin(), src.types.begin() + n);
+    dst.offsets.insert(dst.offsets.end(), src.offsets.begin(), src.offsets.begin() + n);
+    dst.lengths.insert(dst.lengths.end(), src.lengths.begin(), src.lengths.begin() + n);
+}
+
+TokenBuffer tokenize_range(string_view input, size_t begin, size_t end){
+    Lexer l(input.substr(0, end));
+    l._seek(begin);
+    TokenBuffer buf = tokenize(l);
+    buf.source = input;
+    return buf;
+}
+
+// chunks are split speculatively just after a `;`, on the guess that
+// the serial lexer also ends a token there. that is then checked for
+// every split: the chunk before it has to end with that very `;`. from
+// the first split that fails the check, the rest is lexed serially, so
+// the result is always the same as tokenize(input).
+TokenBuffer tokenize_parallel(string_view input, unsigned threads, size_t min_chunk){
+    size_t chunks = min<size_t>(threads, input.size() / max<size_t>(min_chunk, 1));
+    if(chunks <= 1){
+        return tokenize(input);
+    }
+
+    vector<size_t> splits = {0};
+    for(size_t k = 1; k < chunks; k++){
+        size_t target = max(k * input.size() / chunks, splits.back());
+        size_t semi = input.find(';', target);
+        if(semi == string_view::npos){
             break;
-        } 
-        case '*' : {tok = Token(TokenType::ASTERISK, string(1, ch)); break;} 
-        case '/' : {tok = Token(TokenType::FSLASH, string(1, ch)); break;} 
-        case '<' : {tok = Token(TokenType::LT, string(1, ch)); break;} 
-        case '>' : {tok = Token(TokenType::GT, string(1, ch)); break;} 
-
-        case '{' : {tok = Token(TokenType::LBRAC, string(1, ch)); break;} 
-        case '}' : {tok = Token(TokenType::RBRAC, string(1, ch)); break;} 
-        case '\0' : {tok = Token(TokenType::ENDOF, ""); break;} 
-        default : {
-            if(isalpha(ch)){
-                tok.val = _read_identifier();
-                tok.type = lookup_id(tok.val);
-                return tok;
-            } else if(isdigit(ch)){
-                tok.type = TokenType::INT;
-                tok.val = _read_number();
-                return tok;
-            } else{
-                tok = Token(TokenType::ILLEGAL, string(1, ch));
+        }
+        if(semi + 1 > splits.back()){
+            splits.push_back(semi + 1);
+        }
+    }
+    splits.push_back(input.size());
+    chunks = splits.size() - 1;
+
+    vector<TokenBuffer> parts(chunks);
+    atomic<size_t> next_chunk = 0;
+    auto worker = [&](){
+        for(size_t k = next_chunk++; k < chunks; k = next_chunk++){
+            parts[k] = tokenize_range(input, splits[k], splits[k + 1]);
+        }
+    };
+    vector<thread> pool;
+    for(unsigned t = 1; t < min<size_t>(threads, chunks); t++){
+        pool.emplace_back(worker);
+    }
+    worker();
+    for(thread &t : pool){
+        t.join();
+    }
+
+    TokenBuffer buf;
+    buf.source = input;
+    size_t total = 0;
+    for(const TokenBuffer &part : parts){
+        total += part.size();
+    }
+    buf.types.reserve(total);
+    buf.offsets.reserve(total);
+    buf.lengths.reserve(total);
+    for(size_t k = 0; k < chunks; k++){
+        if(k > 0){
+            const TokenBuffer &prev = parts[k - 1];
+            size_t last = prev.size() - 2;
+            bool aligned = prev.size() >= 2 && prev.type(last) == TokenType::SEMICOLON &&
+                prev.offsets[last] == splits[k] - 1;
+            if(!aligned){
+                // pull back the chunk before the bad split and lex the rest serially
+                size_t keep = buf.size() - (prev.size() - 1);
+                buf.types.resize(keep);
+                buf.offsets.resize(keep);
+                buf.lengths.resize(keep);
+                TokenBuffer rest = tokenize_range(input, splits[k - 1], input.size());
+                append_tokens(buf, rest);
+                buf.types.push_back(TokenType::ENDOF);
+                buf.offsets.push_back(input.size());
+                buf.lengths.push_back(0);
+                return buf;
             }
         }
+        append_tokens(buf, parts[k]);
+    }
+    buf.types.push_back(TokenType::ENDOF);
+    buf.offsets.push_back(input.size());
+    buf.lengths.push_back(0);
+    return buf;
+}
+
+MappedFile::MappedFile(const string &path){
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) == 0){
+        size = st.st_size;
+        if(size == 0){
+            data = "";
+            opened = true;
+        }else{
+            void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(addr != MAP_FAILED){
+                data = static_cast<const char*>(addr);
+                opened = true;
+            }
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile(){
+    if(opened && size > 0){
+        munmap(const_cast<char*>(data), size);
     }
-    _read_char();
-    return tok;
 }
 
 void test_next_token(){
@@ -298,4 +716,179 @@ if (5 < 10) {
 
 }
 
-}
\ No newline at end of file
+void test_next_token_view(){
+    printf("Test case #1\n");
+    string input = "let ab = 12 == 3;";
+    vector<TokenView> expected = {
+        {TokenType::LET, "let"},
+        {TokenType::ID, "ab"},
+        {TokenType::ASSIGN, "="},
+        {TokenType::INT, "12"},
+        {TokenType::EQ, "=="},
+        {TokenType::INT, "3"},
+        {TokenType::SEMICOLON, ";"},
+        {TokenType::ENDOF, ""},
+    };
+    Lexer l = Lexer(input);
+
+    unsigned long correct_count = 0;
+    for(int i=0; i<expected.size(); i++){
+        TokenView tok = l.next_token_view();
+        bool in_input = tok.val.empty() || 
+            (tok.val.data() >= input.data() && tok.val.data() < input.data() + input.size());
+        if(expected[i].type != tok.type || expected[i].val != tok.val || !in_input){
+            printf("[error] token mistmatch. Expected %s but found %s\n", 
+                string(expected[i].val).c_str(), string(tok.val).c_str());
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, expected.size());
+
+    printf("Test case #2\n");
+    input = "@fnx fn return returns elsee else iff";
+    expected = {
+        {TokenType::ILLEGAL, "@"},
+        {TokenType::ID, "fnx"},
+        {TokenType::FUNCTION, "fn"},
+        {TokenType::RETURN, "return"},
+        {TokenType::ID, "returns"},
+        {TokenType::ID, "elsee"},
+        {TokenType::ELSE, "else"},
+        {TokenType::ID, "iff"},
+        {TokenType::ENDOF, ""},
+    };
+    l = Lexer(input);
+    correct_count = 0;
+    for(int i=0; i<expected.size(); i++){
+        TokenView tok = l.next_token_view();
+        if(expected[i].type != tok.type || expected[i].val != tok.val){
+            printf("[error] token mistmatch. Expected %s but found %s\n", 
+                string(expected[i].val).c_str(), string(tok.val).c_str());
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, expected.size());
+}
+
+void test_tokenize(){
+    printf("Test case #1\n");
+    string input = "let x = 5;\n  x == 10;";
+    TokenBuffer buf = tokenize(input);
+
+    struct Expected {
+        TokenType type;
+        string_view val;
+        pair<int, int> loc;
+    };
+    vector<Expected> expected = {
+        {TokenType::LET, "let", {1, 1}},
+        {TokenType::ID, "x", {1, 5}},
+        {TokenType::ASSIGN, "=", {1, 7}},
+        {TokenType::INT, "5", {1, 9}},
+        {TokenType::SEMICOLON, ";", {1, 10}},
+        {TokenType::ID, "x", {2, 3}},
+        {TokenType::EQ, "==", {2, 5}},
+        {TokenType::INT, "10", {2, 8}},
+        {TokenType::SEMICOLON, ";", {2, 10}},
+        {TokenType::ENDOF, "", {2, 11}},
+    };
+
+    if(buf.size() != expected.size()){
+        printf("[error] expected %ld tokens, got %ld\n", expected.size(), buf.size());
+        return;
+    }
+    unsigned long correct_count = 0;
+    for(int i=0; i<expected.size(); i++){
+        if(buf.type(i) != expected[i].type || buf.lexeme(i) != expected[i].val ||
+            buf.location(i) != expected[i].loc){
+            printf("[error] token %d mismatch. Expected %s at %d:%d but found %s at %d:%d\n", i,
+                string(expected[i].val).c_str(), expected[i].loc.first, expected[i].loc.second,
+                string(buf.lexeme(i)).c_str(), buf.location(i).first, buf.location(i).second);
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, expected.size());
+}
+
+void test_stream_lexer(){
+    printf("Test case #1\n");
+    string input = R"(let add = fn(x, y){
+    x + y;
+};
+let verylongidentifiername = add(12345678, 10) != 9 == !true;
+)";
+    // a window smaller than most tokens makes nearly every one straddle
+    // a refill
+    unsigned long correct_count = 0;
+    unsigned long total = 0;
+    for(size_t capacity : {1, 3, 4, 16, 4096}){
+        istringstream in(input);
+        StreamLexer s(in, capacity);
+        Lexer l(input);
+        while(true){
+            Token expected = l.next_token();
+            Token tok = s.next_token();
+            total++;
+            if(expected.type != tok.type || expected.val != tok.val){
+                printf("[error] capacity %ld: expected %s but found %s\n", capacity,
+                    expected.val.c_str(), tok.val.c_str());
+            }else{
+                correct_count++;
+            }
+            if(expected.type == TokenType::ENDOF || tok.type == TokenType::ENDOF){
+                break;
+            }
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, total);
+}
+
+void test_tokenize_parallel(){
+    printf("Test case #1\n");
+    string snippet = R"(let add = fn(x, y){ x + y; };
+if (add(1, 2) < 10) { return true; } else { let z = 7; z }
+!-five * ten / 2 == 10 != 9;
+)";
+    string input;
+    for(int i = 0; i < 200; i++){
+        input += snippet;
+    }
+    TokenBuffer expected = tokenize(input);
+
+    unsigned long correct_count = 0;
+    unsigned long total = 0;
+    for(unsigned threads : {1, 2, 3, 8, 64}){
+        TokenBuffer got = tokenize_parallel(input, threads, 64);
+        total++;
+        if(got.types != expected.types || got.offsets != expected.offsets ||
+            got.lengths != expected.lengths){
+            printf("[error] %d threads: token stream differs from serial lexing\n", threads);
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, total);
+    printf("Test case #2\n");
+    // the serial lexer stops at a NUL byte, so the chunks after it must
+    // fail the split check and fall back
+    input[input.size() / 2] = '\0';
+    expected = tokenize(input);
+    correct_count = 0;
+    total = 0;
+    for(unsigned threads : {2, 8}){
+        TokenBuffer got = tokenize_parallel(input, threads, 64);
+        total++;
+        if(got.types != expected.types || got.offsets != expected.offsets ||
+            got.lengths != expected.lengths){
+            printf("[error] %d threads: token stream differs from serial lexing\n", threads);
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, total);
+}
+
+}
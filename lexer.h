@@ -1,71 +1,195 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
 using namespace std;
 
 namespace lexer {
 
-enum TokenType {
-    ILLEGAL,
-    ENDOF,
-    // Identifier and literals
-    ID,
-    INT,
-    // Operators
-    ASSIGN,
-    PLUS,
-    MINUS,
-    BANG,
-    ASTERISK,
-    FSLASH,
-    LT,
-    GT,
-    EQ,
-    NEQ,
-    // Delimiters
-    COMMA,
-    SEMICOLON,
-    // paranthesis
-    LPAREN,
-    RPAREN,
-    // brackets
-    LBRAC,
-    RBRAC,
-    // keywords
-    FUNCTION,
-    LET,
-    TRUE,
-    FALSE,
-    IF,
-    ELSE,
-    RETURN
+// every token the lexer knows about. the TokenType enum, the names used
+// by enum_to_string, the character-class and DFA tables and the keyword
+// hash are all generated from this list, so a new token only has to be
+// added here.
+//   TOKEN(name)              no fixed spelling
+//   PUNCT(name, spelling)    operator or delimiter, every prefix of a
+//                            spelling must be a PUNCT itself
+//   KEYWORD(name, spelling)  reserved identifier
+#define LEXER_TOKENS(TOKEN, PUNCT, KEYWORD) \
+    TOKEN(ILLEGAL) \
+    TOKEN(ENDOF) \
+    /* Identifier and literals */ \
+    TOKEN(ID) \
+    TOKEN(INT) \
+    /* Operators */ \
+    PUNCT(ASSIGN, "=") \
+    PUNCT(PLUS, "+") \
+    PUNCT(MINUS, "-") \
+    PUNCT(BANG, "!") \
+    PUNCT(ASTERISK, "*") \
+    PUNCT(FSLASH, "/") \
+    PUNCT(LT, "<") \
+    PUNCT(GT, ">") \
+    PUNCT(EQ, "==") \
+    PUNCT(NEQ, "!=") \
+    /* Delimiters */ \
+    PUNCT(COMMA, ",") \
+    PUNCT(SEMICOLON, ";") \
+    /* paranthesis */ \
+    PUNCT(LPAREN, "(") \
+    PUNCT(RPAREN, ")") \
+    /* brackets */ \
+    PUNCT(LBRAC, "{") \
+    PUNCT(RBRAC, "}") \
+    /* keywords */ \
+    KEYWORD(FUNCTION, "fn") \
+    KEYWORD(LET, "let") \
+    KEYWORD(TRUE, "true") \
+    KEYWORD(FALSE, "false") \
+    KEYWORD(IF, "if") \
+    KEYWORD(ELSE, "else") \
+    KEYWORD(RETURN, "return")
+
+#define LEXER_ENUM_TOKEN(name) name,
+#define LEXER_ENUM_SPELLED(name, spelling) name,
+enum TokenType : uint8_t {
+    LEXER_TOKENS(LEXER_ENUM_TOKEN, LEXER_ENUM_SPELLED, LEXER_ENUM_SPELLED)
 };
+#undef LEXER_ENUM_TOKEN
+#undef LEXER_ENUM_SPELLED
+
+#define LEXER_COUNT_TOKEN(name) +1
+#define LEXER_COUNT_SPELLED(name, spelling) +1
+constexpr size_t TOKEN_COUNT = 
+    0 LEXER_TOKENS(LEXER_COUNT_TOKEN, LEXER_COUNT_SPELLED, LEXER_COUNT_SPELLED);
+#undef LEXER_COUNT_TOKEN
+#undef LEXER_COUNT_SPELLED
 
 
+// non-owning token, val points into the lexer input
+struct TokenView {
+    TokenType type;
+    string_view val;
+};
+
+// identifier names are interned: each distinct name is stored once, in a
+// process-wide table, and gets a 32-bit symbol id. the parser and the
+// environments key on the id, so a lookup hashes an integer, not a string
+constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+uint32_t intern(string_view name);
+const string &symbol_name(uint32_t sym);
+
 struct Token {
     TokenType type;
     string val;
-    // loc(row, col)
-    pair<int, int> loc;
+    // symbol id of an identifier, NO_SYMBOL for other tokens
+    uint32_t sym = NO_SYMBOL;
     Token() = default;
-    Token(TokenType type, string val) : type(type), val(val) {};
+    Token(TokenType type, string val) : type(type), val(val) {
+        if(type == TokenType::ID) sym = intern(this->val);
+    };
+    Token(TokenView tv) : type(tv.type), val(tv.val) {
+        if(type == TokenType::ID) sym = intern(tv.val);
+    };
 };
 
+// the lexer does not own its input, the caller has to keep the
+// source (string or mapped file) alive while lexing
 struct Lexer {
-    string input;
+    string_view input;
     int position = 0;
     int read_position = 0;
     char ch;
-    Lexer(string input) : input(input){_read_char();};
+    Lexer(string_view input) : input(input){_read_char();};
     // helper function
     void _skip_whitespace();
     void _read_char();
+    void _seek(int pos);
     char _peek_char();
-    string _read_number();
-    string _read_identifier();
 
     Token next_token();
+    TokenView next_token_view();
+};
+
+// lexes from a std::istream or file descriptor through a fixed-size
+// window that is refilled on demand, so memory use does not depend on the
+// size of the script. unread bytes are slid to the front before each
+// refill, which keeps a token contiguous even if it straddled two reads.
+// the window only grows for a single token longer than itself.
+struct StreamLexer {
+    static constexpr size_t DEFAULT_CAPACITY = 64 * 1024;
+
+    istream *in = nullptr;
+    int fd = -1;
+    vector<char> buffer;
+    // unread bytes are buffer[begin, end)
+    size_t begin = 0;
+    size_t end = 0;
+    bool eof = false;
+
+    StreamLexer(istream &in, size_t capacity = DEFAULT_CAPACITY);
+    StreamLexer(int fd, size_t capacity = DEFAULT_CAPACITY);
+    void _refill();
+
+    Token next_token();
+};
+
+// whole input lexed up front, stored as struct-of-arrays. lexemes and
+// locations are recovered from the source on demand.
+struct TokenBuffer {
+    string_view source;
+    vector<uint8_t> types;
+    vector<uint32_t> offsets;
+    vector<uint32_t> lengths;
+    // offsets of the first byte of every line, built on first location()
+    mutable vector<uint32_t> line_starts;
+
+    size_t size() const { return types.size(); }
+    TokenType type(size_t i) const;
+    string_view lexeme(size_t i) const;
+    // (row, col) of token i, both starting from 1
+    pair<int, int> location(size_t i) const;
+};
+
+// lexes the rest of the input, the buffer always ends with ENDOF
+TokenBuffer tokenize(Lexer &l);
+TokenBuffer tokenize(string_view input);
+// lexes input[begin, end) with offsets relative to the whole input
+TokenBuffer tokenize_range(string_view input, size_t begin, size_t end);
+// same result as tokenize(input), lexed in chunks on up to `threads`
+// threads. inputs shorter than threads * min_chunk use fewer threads
+TokenBuffer tokenize_parallel(string_view input, unsigned threads,
+    size_t min_chunk = 256 * 1024);
+
+// read-only mmap of a script file, so it can be lexed in place
+struct MappedFile {
+    const char *data = nullptr;
+    size_t size = 0;
+    bool opened = false;
+
+    MappedFile(const string &path);
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile();
+
+    bool is_open() const { return opened; }
+    string_view view() const { return string_view(data, size); }
 };
 
 string enum_to_string(TokenType t);
+// fixed spelling of a PUNCT or KEYWORD token, empty for the others
+string_view token_spelling(TokenType t);
+// keyword for id, or ID if it is not reserved
+TokenType lookup_id(string_view id);
 void test_next_token();
-}
\ No newline at end of file
+void test_next_token_view();
+void test_tokenize();
+void test_stream_lexer();
+void test_tokenize_parallel();
+}
+
+#endif
\ No newline at end of file
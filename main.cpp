@@ -1,13 +1,93 @@
 // #include "parser.h"
+#include "cache.h"
 #include "evaluator.h"
+#include "gc.h"
+#include "opt.h"
+#include "pool.h"
 #include "repl.h"
+#include "scan.h"
 
 using namespace std;
 
+const char* USAGE = R"(usage: interp.out [-O0|-O1]                                 start the repl
+       interp.out [-O0|-O1] [--cache] [--lazy] <script>     run a script file
+       interp.out [-O0|-O1] [--lazy] -e <code>              run the given code
+  -O0      evaluate the program as parsed
+  -O1      fold constants and drop dead code first (default)
+  --cache  keep the parsed script in <script>c and reuse it while the
+           script is unchanged
+  --lazy   parse a function body on its first call instead of up front;
+           syntax errors in a body are reported when it is called
+collector and allocator options, accepted in every mode:
+  --gc-young=<n>   collect cycles once n objects and environments are
+                   young (default 4096, 0 never collects)
+  --gc-growth=<f>  also collect the old ones once there are f times as
+                   many as after their last collection (default 2)
+  --gc-stats       print collector statistics to stderr at exit
+  --pool-stats     print allocations per object type to stderr at exit
+)";
+
 int main(int argc, char** argv){
+    int opt_level = 1;
+    bool use_cache = false;
+    bool lazy_bodies = false;
+    bool gc_stats = false;
+    bool pool_stats = false;
+    int first = 1;
+    for(; first < argc; first++){
+        string flag = argv[first];
+        if(flag == "-O0" || flag == "-O1"){
+            opt_level = flag[2] - '0';
+        }else if(flag == "--cache"){
+            use_cache = true;
+        }else if(flag == "--lazy"){
+            lazy_bodies = true;
+        }else if(flag.starts_with("--gc-young=")){
+            gc::heap.config.young_limit = strtoull(flag.c_str() + 11, nullptr, 10);
+        }else if(flag.starts_with("--gc-growth=")){
+            gc::heap.config.old_growth = strtod(flag.c_str() + 12, nullptr);
+        }else if(flag == "--gc-stats"){
+            gc_stats = true;
+        }else if(flag == "--pool-stats"){
+            pool_stats = true;
+        }else{
+            break;
+        }
+    }
+    int rest = argc - first;
+    if(rest > 0){
+        string arg = argv[first];
+        int code = 2;
+        if(arg == "-e" && rest == 2){
+            code = repl::run_string(argv[first + 1], opt_level, lazy_bodies);
+        }else if(arg[0] != '-' && rest == 1){
+            code = repl::run_file(arg, opt_level, use_cache, lazy_bodies);
+        }else{
+            fprintf(stderr, "%s", USAGE);
+            return code;
+        }
+        if(gc_stats){
+            gc::print_stats(stderr);
+        }
+        if(pool_stats){
+            pool::print_usage(stderr);
+        }
+        return code;
+    }
     printf("interp running\n");
+    // scan::test_scan();
     // lexer::test_next_token();
-    repl::start();
+    // lexer::test_next_token_view();
+    // lexer::test_tokenize();
+    // lexer::test_stream_lexer();
+    // lexer::test_tokenize_parallel();
+    repl::start(opt_level);
+    if(gc_stats){
+        gc::print_stats(stderr);
+    }
+    if(pool_stats){
+        pool::print_usage(stderr);
+    }
     // parser::test_let_statements();
     // parser::test_ret_statements();
     // parser::test_string();
@@ -18,7 +98,22 @@ int main(int argc, char** argv){
     // parser::test_operator_precedence_parsing();
     // parser::test_if_expression();
     // parser::test_call_expression();
+    // parser::test_arena_teardown();
+    // parser::test_deep_nesting();
+    // resolver::test_resolve();
     // eval::test_eval_integer_expression();
+    // eval::test_eval_reuses_ast();
+    // eval::test_eval_lazy_bodies();
+    // eval::test_eval_values();
+    // eval::test_eval_shares_objects();
+    // eval::test_eval_collects_cycles();
+    // flat::test_flatten();
+    // flat::test_eval_flat();
+    // opt::test_optimize();
+    // pool::test_pool();
+    // gc::test_collect();
+    // cache::test_cache();
+    // reparse::test_reparse();
     
     return 0;
 }
\ No newline at end of file
@@ -1,91 +1,213 @@
+#ifndef OBJECT_H
+#define OBJECT_H
+
+#include "gc.h"
 #include "parser.h"
+#include "pool.h"
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <memory>
-#include <unordered_map>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 
 namespace object {
-using ObjectType = std::string;
+// names used in messages, e.g. "type mismatch: INTEGER + BOOLEAN"
+using ObjectType = std::string_view;
 
-const std::string BOOLEAN_OBJ = "BOOLEAN";
-const std::string INTEGER_OBJ  = "INTEGER";
-const std::string NULL_OBJ = "NULL";
-const std::string RETURN_VALUE_OBJ = "RETURN_VALUE";
-const std::string ERROR_OBJ = "ERROR";
-const std::string FUNCTION_OBJ = "FUNCTION";
+constexpr ObjectType BOOLEAN_OBJ = "BOOLEAN";
+constexpr ObjectType INTEGER_OBJ  = "INTEGER";
+constexpr ObjectType NULL_OBJ = "NULL";
+constexpr ObjectType RETURN_VALUE_OBJ = "RETURN_VALUE";
+constexpr ObjectType ERROR_OBJ = "ERROR";
+constexpr ObjectType FUNCTION_OBJ = "FUNCTION";
 
-struct Object {
-    virtual ObjectType type() const = 0;
-    virtual std::string inspect() const = 0;
-    virtual std::unique_ptr<Object> clone() const = 0;
-    virtual ~Object() {};
+enum class Tag : uint8_t {
+    // no value, e.g. the result of a let statement
+    NONE,
+    NIL,
+    INTEGER,
+    BOOLEAN,
+    // the rest live on the heap as an Object
+    ERROR,
+    FUNCTION,
 };
 
-struct Error : Object {
-    std::string message;
-    ObjectType type() const override;
-    std::string inspect() const override;
-    std::unique_ptr<Object> clone() const override;
-    Error(std::string message) : message(message) {};
-};
+ObjectType type_name(Tag tag);
+
+// objects and environments are shared through the reference count in
+// their gc::Cell. they are never changed once built, so sharing one is the
+// same as copying it. an interpreter runs on one thread, so the count is a
+// plain integer and taking a reference costs an increment, not an atomic.
+// cycles between them are left to the collector in gc.h
+template <typename T>
+void retain(const T *p){
+    p->refs++;
+}
+
+template <typename T>
+void release(const T *p){
+    if(--p->refs == 0){
+        delete p;
+    }
+}
+
+// shared pointer over a gc::Cell
+template <typename T>
+struct Ref {
+    T *ptr = nullptr;
+
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+    explicit Ref(T *p) : ptr(p) {
+        if(ptr != nullptr) retain(ptr);
+    }
+    Ref(const Ref &other) : Ref(other.ptr) {}
+    Ref(Ref &&other) noexcept : ptr(std::exchange(other.ptr, nullptr)) {}
+    Ref &operator=(Ref other) noexcept {
+        std::swap(ptr, other.ptr);
+        return *this;
+    }
+    ~Ref(){
+        if(ptr != nullptr) release(ptr);
+    }
+
+    template <typename... Args>
+    static Ref make(Args&&... args){
+        return Ref(new T(std::forward<Args>(args)...));
+    }
 
-struct ReturnValue : Object {
-    std::unique_ptr<Object> value;
-    ObjectType type() const override;
-    std::string inspect() const override; 
-    std::unique_ptr<Object> clone() const override;
-    ReturnValue(std::unique_ptr<Object> value) : value(std::move(value)) {};
+    T *get() const { return ptr; }
+    T *operator->() const { return ptr; }
+    T &operator*() const { return *ptr; }
+    explicit operator bool() const { return ptr != nullptr; }
 };
 
-struct Integer : Object {
-    int64_t value;
-    ObjectType type() const override;
-    std::string inspect() const override;
-    std::unique_ptr<Object> clone() const override;
-    Integer(int64_t value) : value(value) {};
+// heap part of the reference types, errors and functions. the concrete
+// types take their memory from the pools in pool.h
+struct Object : gc::Cell {
+    virtual Tag tag() const = 0;
+    ObjectType type() const { return type_name(tag()); }
+    virtual std::string inspect() const = 0;
+    virtual ~Object() {};
 };
 
-struct Boolean : Object {
-    bool value;
-    ObjectType type() const override;
-    std::string inspect() const override;
-    std::unique_ptr<Object> clone() const override;
-    Boolean(bool value) : value(value) {};
+// result of evaluating anything: integers, booleans and null are stored
+// inline, so arithmetic and comparisons allocate nothing. a heap value
+// holds a reference to its object
+struct Value {
+    Tag tag = Tag::NONE;
+    // set on the value of a `return` while it unwinds to the enclosing
+    // call or the program, instead of wrapping it in a ReturnValue object
+    bool returning = false;
+    union {
+        int64_t integer = 0;
+        bool boolean;
+        const Object *object;
+    };
+
+    Value() = default;
+    Value(const Value &other) : tag(other.tag), returning(other.returning),
+        integer(other.integer) {
+        if(is_heap()) retain(object);
+    }
+    Value(Value &&other) noexcept : tag(other.tag), returning(other.returning),
+        integer(other.integer) {
+        other.tag = Tag::NONE;
+    }
+    Value &operator=(Value other) noexcept {
+        std::swap(tag, other.tag);
+        std::swap(returning, other.returning);
+        std::swap(integer, other.integer);
+        return *this;
+    }
+    ~Value(){
+        if(is_heap()) release(object);
+    }
+
+    static Value null(){ Value v; v.tag = Tag::NIL; return v; }
+    static Value from_int(int64_t i){ Value v; v.tag = Tag::INTEGER; v.integer = i; return v; }
+    static Value from_bool(bool b){ Value v; v.tag = Tag::BOOLEAN; v.boolean = b; return v; }
+    // a value holding a new T
+    template <typename T, typename... Args>
+    static Value make(Args&&... args){
+        Value v;
+        v.object = new T(std::forward<Args>(args)...);
+        v.tag = v.object->tag();
+        retain(v.object);
+        return v;
+    }
+
+    bool is_heap() const { return tag >= Tag::ERROR; }
+    bool is_error() const { return tag == Tag::ERROR; }
+    explicit operator bool() const { return tag != Tag::NONE; }
+    ObjectType type() const { return returning ? RETURN_VALUE_OBJ : type_name(tag); }
+    std::string inspect() const;
+    // the heap object as T, or null
+    template <typename T>
+    const T *as() const { return is_heap() ? dynamic_cast<const T*>(object) : nullptr; }
 };
+static_assert(sizeof(Value) == 16);
 
-struct Null : Object {
-    ObjectType type() const override;
+struct Error : Object, pool::Pooled<Error> {
+    const std::string message;
+    Tag tag() const override { return Tag::ERROR; }
     std::string inspect() const override;
-    std::unique_ptr<Object> clone() const override;
+    Error(std::string message) : message(std::move(message)) {};
 };
 
-struct Environment {
-    std::unique_ptr<Environment> *outer;
-    std::unordered_map<std::string, std::unique_ptr<object::Object>> store;
-    std::tuple<std::unique_ptr<object::Object>, bool> get(std::string name);
-    std::unique_ptr<object::Object> set(std::string name, std::unique_ptr<object::Object>val);
-    Environment(std::unique_ptr<Environment> *outer) : outer(outer) {}
+// calls tracer.visit on the object a value holds, if any
+inline void trace(const Value &value, gc::Tracer &tracer){
+    if(value.is_heap()){
+        tracer.visit(const_cast<Object*>(value.object));
+    }
+}
+
+// one frame of variables, addressed by the resolver (resolver.h). a call's
+// frame has a slot per parameter and let of the function; the outermost
+// one is indexed by symbol id and grows as globals are set. a slot that
+// was never set holds Tag::NONE
+struct Environment : gc::Cell, pool::Pooled<Environment> {
+    // only reset by clear()
+    Ref<Environment> outer;
+    std::vector<Value, pool::Allocator<Value>> slots;
+    // the value in slot of the environment depth levels out
+    std::tuple<Value, bool> get(uint32_t depth, uint32_t slot) const;
+    Value set(uint32_t slot, Value val);
+    void trace(gc::Tracer &tracer) const override;
+    void clear() override;
+    Environment(Ref<Environment> outer, uint32_t size = 0) :
+        outer(std::move(outer)), slots(size) {
+        gc::track(this);
+    }
 };
 
-struct Function : Object {
-    std::vector<std::unique_ptr<parser::Identifier>> parameters;
-    std::unique_ptr<parser::BlockStatement> body;
-    std::unique_ptr<Environment> &environment;
-    ObjectType type() const override;
+struct Function : Object, pool::Pooled<Function> {
+    // the literal is shared with the tree it was parsed into (through the
+    // tree's arena), so calling or copying a function never copies the body
+    const std::shared_ptr<const parser::FunctionLiteral> literal;
+    // the scope the function was created in, shared with it. only reset
+    // by clear()
+    Ref<Environment> environment;
+    Tag tag() const override { return Tag::FUNCTION; }
     std::string inspect() const override;
-    std::unique_ptr<Object> clone() const override;
+    void trace(gc::Tracer &tracer) const override;
+    void clear() override;
 
-    Function(std::vector<std::unique_ptr<parser::Identifier>> params,
-        std::unique_ptr<parser::BlockStatement> body,
-        std::unique_ptr<Environment> &environment): 
-        parameters(std::move(params)), body(std::move(body)), 
-        environment(environment){};
+    Function(std::shared_ptr<const parser::FunctionLiteral> literal,
+        Ref<Environment> environment):
+        literal(std::move(literal)), environment(std::move(environment)){
+        gc::track(this);
+    };
 };
 
-std::unique_ptr<Environment> new_enclosed_environment(std::unique_ptr<Environment> &outer);
+Ref<Environment> new_environment();
+// a call's frame of size slots
+Ref<Environment> new_enclosed_environment(const Ref<Environment> &outer, uint32_t size);
+
 
+}
 
-} 
\ No newline at end of file
+#endif
@@ -0,0 +1,248 @@
+#include "opt.h"
+#include "evaluator.h"
+#include <cstdio>
+#include <fmt/format.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace opt {
+
+namespace {
+
+struct Optimizer {
+    // new nodes go into the program's arena, next to the ones they replace
+    parser::AstArena *arena;
+    Stats stats;
+
+    parser::NodePtr<parser::Expression> integer(int64_t val){
+        stats.folded++;
+        return parser::make_node<parser::IntegerLiteral>(arena,
+            arena->span(lexer::TokenType::INT, fmt::to_string(val)), val);
+    }
+
+    parser::NodePtr<parser::Expression> boolean(bool val){
+        stats.folded++;
+        auto type = val ? lexer::TokenType::TRUE : lexer::TokenType::FALSE;
+        return parser::make_node<parser::Boolean>(arena,
+            arena->span(type, lexer::token_spelling(type)), val);
+    }
+
+    void block(std::vector<parser::NodePtr<parser::Statement>> &statements){
+        for(size_t i = 0; i < statements.size(); i++){
+            statement(statements[i]);
+            if(dynamic_cast<parser::ReturnStatement*>(statements[i].get()) != nullptr){
+                stats.unreachable += statements.size() - i - 1;
+                statements.resize(i + 1);
+                return;
+            }
+        }
+    }
+
+    void statement(parser::NodePtr<parser::Statement> &stmt){
+        if(auto p = dynamic_cast<parser::LetStatement*>(stmt.get())){
+            expression(p->value);
+        }else if(auto p = dynamic_cast<parser::ReturnStatement*>(stmt.get())){
+            expression(p->return_value);
+        }else if(auto p = dynamic_cast<parser::ExpressionStatement*>(stmt.get())){
+            expression(p->expr);
+        }else if(auto p = dynamic_cast<parser::BlockStatement*>(stmt.get())){
+            block(p->statements);
+        }
+    }
+
+    void prefix(parser::NodePtr<parser::Expression> &exp, parser::PrefixExpression *p){
+        expression(p->right);
+        if(auto right = dynamic_cast<parser::IntegerLiteral*>(p->right.get())){
+            if(p->op == lexer::TokenType::MINUS && right->val != INT64_MIN){
+                exp = integer(-right->val);
+            }else if(p->op == lexer::TokenType::BANG){
+                exp = boolean(right->val == 0);
+            }
+        }else if(auto right = dynamic_cast<parser::Boolean*>(p->right.get())){
+            if(p->op == lexer::TokenType::BANG){
+                exp = boolean(!right->val);
+            }
+        }
+    }
+
+    void infix(parser::NodePtr<parser::Expression> &exp, parser::InfixExpression *p){
+        expression(p->left);
+        expression(p->right);
+        auto left_int = dynamic_cast<parser::IntegerLiteral*>(p->left.get());
+        auto right_int = dynamic_cast<parser::IntegerLiteral*>(p->right.get());
+        if(left_int != nullptr && right_int != nullptr){
+            int64_t l = left_int->val, r = right_int->val, out;
+            switch(p->op){
+                case lexer::TokenType::PLUS:
+                    if(!__builtin_add_overflow(l, r, &out)) exp = integer(out);
+                    break;
+                case lexer::TokenType::MINUS:
+                    if(!__builtin_sub_overflow(l, r, &out)) exp = integer(out);
+                    break;
+                case lexer::TokenType::ASTERISK:
+                    if(!__builtin_mul_overflow(l, r, &out)) exp = integer(out);
+                    break;
+                case lexer::TokenType::FSLASH:
+                    if(r != 0 && !(l == INT64_MIN && r == -1)) exp = integer(l / r);
+                    break;
+                case lexer::TokenType::LT: exp = boolean(l < r); break;
+                case lexer::TokenType::GT: exp = boolean(l > r); break;
+                case lexer::TokenType::EQ: exp = boolean(l == r); break;
+                case lexer::TokenType::NEQ: exp = boolean(l != r); break;
+                default: break;
+            }
+            return;
+        }
+        auto left_bool = dynamic_cast<parser::Boolean*>(p->left.get());
+        auto right_bool = dynamic_cast<parser::Boolean*>(p->right.get());
+        if(left_bool != nullptr && right_bool != nullptr){
+            if(p->op == lexer::TokenType::EQ){
+                exp = boolean(left_bool->val == right_bool->val);
+            }else if(p->op == lexer::TokenType::NEQ){
+                exp = boolean(left_bool->val != right_bool->val);
+            }
+        }
+    }
+
+    // the if node stays, since a false condition without else still has to
+    // produce null; only the branch that can never run is dropped
+    void if_expression(parser::IfExpression *p){
+        expression(p->cond);
+        if(p->consequence != nullptr){
+            block(p->consequence->statements);
+        }
+        if(p->alternative != nullptr){
+            block(p->alternative->statements);
+        }
+
+        bool truthy;
+        if(auto cond = dynamic_cast<parser::Boolean*>(p->cond.get())){
+            truthy = cond->val;
+        }else if(dynamic_cast<parser::IntegerLiteral*>(p->cond.get()) != nullptr){
+            truthy = true;
+        }else{
+            return;
+        }
+
+        if(truthy){
+            if(p->alternative != nullptr){
+                p->alternative = nullptr;
+                stats.branches++;
+            }
+        }else if(p->alternative != nullptr){
+            p->consequence = std::move(p->alternative);
+            p->cond = boolean(true);
+            stats.branches++;
+        }else if(p->consequence != nullptr && !p->consequence->statements.empty()){
+            p->consequence->statements.clear();
+            stats.branches++;
+        }
+    }
+
+    void expression(parser::NodePtr<parser::Expression> &exp){
+        if(exp == nullptr){
+            return;
+        }
+        if(auto p = dynamic_cast<parser::PrefixExpression*>(exp.get())){
+            prefix(exp, p);
+        }else if(auto p = dynamic_cast<parser::InfixExpression*>(exp.get())){
+            infix(exp, p);
+        }else if(auto p = dynamic_cast<parser::IfExpression*>(exp.get())){
+            if_expression(p);
+        }else if(auto p = dynamic_cast<parser::FunctionLiteral*>(exp.get())){
+            if(p->body != nullptr){
+                block(p->body->statements);
+            }
+        }else if(auto p = dynamic_cast<parser::CallExpression*>(exp.get())){
+            expression(p->function);
+            for(auto &arg : p->arguments){
+                expression(arg);
+            }
+        }
+    }
+};
+
+}
+
+Stats optimize(parser::Program &program, int level){
+    Optimizer optimizer{program.arena.get(), {}};
+    if(level >= 1){
+        optimizer.block(program.statements);
+    }
+    return optimizer.stats;
+}
+
+void test_optimize(){
+    struct Test {
+        std::string input;
+        std::string expected;
+    };
+
+    std::vector<Test> tests = {
+        {"(5 + 10 * 2) / 3", "8"},
+        {"10 - 2 - 3", "5"},
+        {"-(2 * 3) + x", "(-6 + x)"},
+        {"!true == false", "true"},
+        {"!0", "true"},
+        {"let a = 2 * 3 + b;", "let a = (6 + b);"},
+        {"5 / 0", "(5 / 0)"},
+        {"-true", "(-true)"},
+        {"1 + true", "(1 + true)"},
+        {"if (1 < 2) { 10 } else { 20 }", "iftrue {\n10\n}"},
+        {"if (false) { 10 } else { 20 }", "iftrue {\n20\n}"},
+        {"if (false) { 10 }", "iffalse {\n}"},
+        {"if (x) { 1 + 1 } else { 2 }", "ifx {\n2\n}{\n2\n}"},
+        {"fn(x) { return x; x + 1; }", "fn(x){\n{\nreturn x;\n}\n}"},
+        {"return 1; 2; 3", "return 1;"},
+    };
+
+    int passed = 0;
+    for(auto &test : tests){
+        lexer::Lexer l(test.input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        optimize(*program);
+        if(program->string() != test.expected){
+            printf("[error] optimizing %s: expected %s, got %s\n", test.input.c_str(),
+                test.expected.c_str(), program->string().c_str());
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, tests.size());
+
+    // the optimized program has to evaluate to the same thing
+    std::vector<std::string> programs = {
+        "(5 + 10 * 2 + 15 / 3) * 2 + -10",
+        "let a = 5; let b = a * 2; if (a * 2 == b) { a + b } else { 0 }",
+        "if (1 > 2) { 10 }",
+        "5 + true",
+        "-true",
+        "let f = fn(x) { return x * (2 + 3); 7 }; f(4)",
+        "return 3; 4",
+    };
+    passed = 0;
+    for(auto &input : programs){
+        auto expected = eval::test_eval(input);
+
+        lexer::Lexer l(input);
+        auto p = parser::Parser(l);
+        auto program = p.parse_program();
+        optimize(*program);
+        auto environment = object::new_environment();
+        auto got = eval::eval(*program, environment);
+
+        std::string want = expected ? expected.inspect() : "nullptr";
+        std::string have = got ? got.inspect() : "nullptr";
+        if(want != have){
+            printf("[error] optimized eval of %s: expected %s, got %s\n",
+                input.c_str(), want.c_str(), have.c_str());
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, programs.size());
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef OPT_H
+#define OPT_H
+
+// optimization pass run between parse_program and eval.
+//   level 0  leaves the program untouched
+//   level 1  folds constant integer and boolean subexpressions, drops the
+//            dead branch of an if whose condition is a literal and removes
+//            statements after a return in a block
+// anything that would fail or overflow at runtime (5 / 0, -true) is left
+// for the evaluator, so errors are reported exactly as without the pass.
+// function bodies skipped by a lazy parse (Parser::lazy_bodies) are parsed
+// on their first call and run unoptimized
+
+#include "parser.h"
+#include <cstddef>
+
+namespace opt {
+
+struct Stats {
+    size_t folded = 0;
+    size_t branches = 0;
+    size_t unreachable = 0;
+};
+
+Stats optimize(parser::Program &program, int level = 1);
+
+void test_optimize();
+
+}
+
+#endif
@@ -1,9 +1,14 @@
 #include "parser.h"
+#include "resolver.h"
+#include "scan.h"
 #include <any>
+#include <array>
 #include <cstdint>
 #include <cstdio>
 #include <fmt/format.h>
 #include <memory>
+#include <mutex>
+#include <string_view>
 #include <typeinfo>
 
 namespace parser {
@@ -18,73 +23,156 @@ enum operation_prec {
     CALL
 };
 
-unordered_map<lexer::TokenType, int> precedences = {
-    {lexer::TokenType::EQ, operation_prec::EQUALS},    
-    {lexer::TokenType::NEQ, operation_prec::EQUALS},    
-    {lexer::TokenType::LT, operation_prec::LESSGREATER},    
-    {lexer::TokenType::GT, operation_prec::LESSGREATER},    
-    {lexer::TokenType::PLUS, operation_prec::SUM},    
-    {lexer::TokenType::MINUS, operation_prec::SUM},    
-    {lexer::TokenType::FSLASH, operation_prec::PRODUCT},    
-    {lexer::TokenType::ASTERISK, operation_prec::PRODUCT},    
-    {lexer::TokenType::LPAREN, operation_prec::CALL}
-};
-
-
-std::string BlockStatement::token_literal() const {
-    return token.val;
-}
-
-std::string IfExpression::token_literal() const {
-    return token.val;
-}
+constexpr std::array<ParseRule, lexer::TOKEN_COUNT> build_parse_rules(){
+    using Prefix = ParseRule::Prefix;
+    using Infix = ParseRule::Infix;
+    std::array<ParseRule, lexer::TOKEN_COUNT> rules = {};
+    auto leaf = [&](lexer::TokenType t, NodePtr<Expression> (Parser::*fn)()){
+        rules[t].prefix = Prefix::LEAF;
+        rules[t].leaf = fn;
+    };
+    auto infix = [&](lexer::TokenType t, int prec, Infix kind){
+        rules[t].infix = kind;
+        rules[t].precedence = prec;
+    };
+    leaf(lexer::TokenType::ID, &Parser::parse_identifier);
+    leaf(lexer::TokenType::INT, &Parser::parse_integer_literal);
+    leaf(lexer::TokenType::TRUE, &Parser::parse_boolean);
+    leaf(lexer::TokenType::FALSE, &Parser::parse_boolean);
+    leaf(lexer::TokenType::IF, &Parser::parse_if_expression);
+    leaf(lexer::TokenType::FUNCTION, &Parser::parse_function_literal);
+    rules[lexer::TokenType::BANG].prefix = Prefix::OPERATOR;
+    rules[lexer::TokenType::MINUS].prefix = Prefix::OPERATOR;
+    rules[lexer::TokenType::LPAREN].prefix = Prefix::GROUP;
+
+    infix(lexer::TokenType::EQ, operation_prec::EQUALS, Infix::OPERATOR);
+    infix(lexer::TokenType::NEQ, operation_prec::EQUALS, Infix::OPERATOR);
+    infix(lexer::TokenType::LT, operation_prec::LESSGREATER, Infix::OPERATOR);
+    infix(lexer::TokenType::GT, operation_prec::LESSGREATER, Infix::OPERATOR);
+    infix(lexer::TokenType::PLUS, operation_prec::SUM, Infix::OPERATOR);
+    infix(lexer::TokenType::MINUS, operation_prec::SUM, Infix::OPERATOR);
+    infix(lexer::TokenType::FSLASH, operation_prec::PRODUCT, Infix::OPERATOR);
+    infix(lexer::TokenType::ASTERISK, operation_prec::PRODUCT, Infix::OPERATOR);
+    infix(lexer::TokenType::LPAREN, operation_prec::CALL, Infix::CALL);
+    return rules;
+}
+
+constexpr auto parse_rules = build_parse_rules();
+
+namespace {
+
+// the span side table. ids are handed to arenas a page at a time and the
+// page goes back to the free list with its arena, so the table only grows
+// with the number of live trees. the page directory is a fixed array and
+// a page is never freed, so lookups need no lock
+struct SpanTable {
+    static constexpr uint32_t PAGE_BITS = AstArena::SPAN_PAGE_BITS;
+    static constexpr uint32_t PAGE_SIZE = AstArena::SPAN_PAGE_SIZE;
+    static constexpr uint32_t MAX_PAGES = 1u << 16;
+
+    std::mutex lock;
+    SpanEntry *pages[MAX_PAGES] = {};
+    uint32_t page_count = 0;
+    std::vector<uint32_t> free_pages;
+
+    SpanTable(){
+        // page 0 is kept for NO_SPAN, which prints as nothing
+        pages[0] = new SpanEntry[PAGE_SIZE]();
+        pages[0][NO_SPAN] = {"", 0, lexer::TokenType::ILLEGAL};
+        page_count = 1;
+    }
+
+    uint32_t claim(){
+        std::lock_guard guard(lock);
+        if(!free_pages.empty()){
+            uint32_t page = free_pages.back();
+            free_pages.pop_back();
+            return page;
+        }
+        if(page_count == MAX_PAGES){
+            fprintf(stderr, "span table is full\n");
+            abort();
+        }
+        pages[page_count] = new SpanEntry[PAGE_SIZE];
+        return page_count++;
+    }
 
-std::string LetStatement::token_literal() const {
-    return let_token.val;
-}
+    void release(const std::vector<uint32_t> &list){
+        std::lock_guard guard(lock);
+        free_pages.insert(free_pages.end(), list.begin(), list.end());
+    }
 
-std::string ReturnStatement::token_literal() const {
-    return ret_token.val;
-}
+    SpanEntry &entry(uint32_t span){
+        return pages[span >> PAGE_BITS][span & (PAGE_SIZE - 1)];
+    }
+};
 
-std::string ExpressionStatement::token_literal() const {
-    return expr_token.val;
+SpanTable &span_table(){
+    static SpanTable table;
+    return table;
 }
 
-std::string Identifier::token_literal() const {
-    return token.val;
 }
 
-std::string IntegerLiteral::token_literal() const {
-    return token.val;
+std::string_view span_text(uint32_t span){
+    const SpanEntry &entry = span_table().entry(span);
+    return std::string_view(entry.text, entry.length);
 }
 
-std::string FunctionLiteral::token_literal() const {
-    return token.val;
+lexer::TokenType span_type(uint32_t span){
+    return span_table().entry(span).type;
 }
 
-std::string Boolean::token_literal() const {
-    return token.val;
+void AstArena::_span_page(){
+    SpanTable &table = span_table();
+    uint32_t page = table.claim();
+    span_pages.push_back(page);
+    span_page = table.pages[page];
+    next_span = page << SPAN_PAGE_BITS;
+    span_end = next_span + SPAN_PAGE_SIZE;
 }
 
-std::string CallExpression::token_literal() const {
-    return token.val;
+void *AstArena::allocate(size_t size, size_t align){
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1);
+    if(cur == nullptr || p + size > reinterpret_cast<uintptr_t>(end)){
+        size_t block_size = std::max(BLOCK_SIZE, size + align);
+        blocks.push_back(std::make_unique_for_overwrite<char[]>(block_size));
+        cur = blocks.back().get();
+        end = cur + block_size;
+        block_ranges.emplace_back(reinterpret_cast<uintptr_t>(cur),
+            reinterpret_cast<uintptr_t>(end));
+        p = (reinterpret_cast<uintptr_t>(cur) + align - 1) & ~(align - 1);
+    }
+    cur = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
 }
 
-std::string PrefixExpression::token_literal() const {
-    return token.val;
+// one linear pass over the nodes; each destructor only releases what the
+// node itself holds (strings, child vectors), the blocks go all at once
+AstArena::~AstArena(){
+    std::sort(block_ranges.begin(), block_ranges.end());
+    const AstArena *outer = releasing;
+    releasing = this;
+    for(Node *node : nodes){
+        node->~Node();
+    }
+    releasing = outer;
+    span_table().release(span_pages);
 }
 
-std::string InfixExpression::token_literal() const {
-    return token.val;
+bool AstArena::owns(const void *node) const {
+    uintptr_t p = reinterpret_cast<uintptr_t>(node);
+    auto it = std::upper_bound(block_ranges.begin(), block_ranges.end(),
+        std::make_pair(p, UINTPTR_MAX));
+    return it != block_ranges.begin() && p < std::prev(it)->second;
 }
 
 bool Parser::_cur_tok_is(lexer::TokenType t) {
-    return cur_token.type == t;
+    return tokens.type(cur_pos) == t;
 }
 
 bool Parser::_peek_tok_is(lexer::TokenType t){
-    return peek_token.type == t;
+    return tokens.type(cur_pos + 1) == t;
 }
 
 bool Parser::_expect_peek(lexer::TokenType t){
@@ -98,17 +186,11 @@ bool Parser::_expect_peek(lexer::TokenType t){
 }
 
 int Parser::_peek_precedence(){
-    if(precedences.find(peek_token.type) != precedences.end()){
-        return precedences[peek_token.type]; 
-    }
-    return operation_prec::LOWEST;
+    return parse_rules[tokens.type(cur_pos + 1)].precedence;
 }
 
 int Parser::_cur_precedence(){
-    if(precedences.find(cur_token.type) != precedences.end()){
-        return precedences[cur_token.type]; 
-    }
-    return operation_prec::LOWEST;
+    return parse_rules[tokens.type(cur_pos)].precedence;
 }
 
 
@@ -117,25 +199,31 @@ vector<std::string> Parser::get_errors(){
     return errors;
 }
 
-// TODO: write helper function to conver enum to string
+// line:col is only worked out here, when there is an error to report
+std::string Parser::_location(size_t pos){
+    auto [row, col] = tokens.location(pos);
+    return fmt::format("{}:{}", row, col);
+}
+
 void Parser::_peek_error(lexer::TokenType t){
-    std::string error_msg = fmt::format("expected next token to be {}, got {} instead",
+    std::string error_msg = fmt::format("{}: expected next token to be {}, got {} instead",
+        _location(cur_pos + 1),
         lexer::enum_to_string(t), 
-        lexer::enum_to_string(peek_token.type)
+        lexer::enum_to_string(tokens.type(cur_pos + 1))
     );
     errors.push_back(error_msg);
     return;
 }
 
-unique_ptr<LetStatement> Parser::parse_let_statement(){
-    auto stmt = make_unique<LetStatement>();  
-    stmt->let_token = cur_token;
+NodePtr<LetStatement> Parser::parse_let_statement(){
+    auto stmt = _make_node<LetStatement>();  
+    stmt->span = _span();
 
     if(!_expect_peek(lexer::TokenType::ID)){
         return nullptr;
     }
 
-    stmt->name = std::make_unique<Identifier>(cur_token, cur_token.val);
+    stmt->name = _make_node<Identifier>(_span(), _symbol());
     if(!_expect_peek(lexer::TokenType::ASSIGN)){
         return nullptr;
     }
@@ -150,9 +238,9 @@ unique_ptr<LetStatement> Parser::parse_let_statement(){
     return stmt;
 }
 
-unique_ptr<ReturnStatement> Parser::parse_ret_statement(){
-    auto stmt = std::make_unique<ReturnStatement>();
-    stmt->ret_token = cur_token;
+NodePtr<ReturnStatement> Parser::parse_ret_statement(){
+    auto stmt = _make_node<ReturnStatement>();
+    stmt->span = _span();
     next_token();
     stmt->return_value = parse_expression(operation_prec::LOWEST);
     if(_peek_tok_is(lexer::TokenType::SEMICOLON)){
@@ -161,62 +249,250 @@ unique_ptr<ReturnStatement> Parser::parse_ret_statement(){
     return stmt;
 }
 
-unique_ptr<Expression> Parser::parse_boolean(){
-    return std::make_unique<Boolean>(cur_token, _cur_tok_is(lexer::TokenType::TRUE));
-}
+NodePtr<Expression> Parser::parse_boolean(){
+    return _make_node<Boolean>(_span(), _cur_tok_is(lexer::TokenType::TRUE));
+}
+
+// pratt parser on an explicit stack. where the recursive formulation
+// would call parse_expression for an operand (after a prefix operator,
+// inside parentheses, right of an infix operator, a call argument) a
+// frame is pushed instead, so deeply nested or very long expressions use
+// heap memory rather than native stack. parse_rules says what each token
+// does; only leaves (literals, identifiers, if, fn) have a function of
+// their own
+NodePtr<Expression> Parser::parse_expression(int precedence = 0){
+    using Prefix = ParseRule::Prefix;
+    using Infix = ParseRule::Infix;
+    // frames of this call are _frames[bottom, ...), calls nested through
+    // if and fn stack theirs on top. the vector is kept between calls, so
+    // an expression costs no allocation for its frames
+    size_t bottom = _frames.size();
+    size_t base = nesting;
+    // a level of nesting is a frame waiting for an operand; the EXPR frame
+    // that goes with it is free
+    auto push = [&](ExprFrame::Kind kind, int prec, NodePtr<Expression> node,
+        size_t height){
+        if(kind != ExprFrame::EXPR && nesting >= max_nesting){
+            _nesting_error();
+        }
+        _frames.emplace_back(kind, prec, std::move(node), height);
+        nesting += kind != ExprFrame::EXPR;
+    };
+    auto pop = [&](){
+        nesting -= _frames.back().kind != ExprFrame::EXPR;
+        _frames.pop_back();
+    };
 
-unique_ptr<Expression> Parser::parse_grouped_expression(){
-    next_token();
-    auto exp = parse_expression(operation_prec::LOWEST);
-    if(!_expect_peek(lexer::TokenType::RPAREN)){
-        return nullptr;
-    }
-    return exp;
-}
+    // DESCEND starts a parse_expression(prec) call at cur_pos, LOOP runs
+    // the infix loop of the EXPR frame on top, DELIVER hands value, the
+    // result of the innermost call, to the frame that asked for it
+    enum { DESCEND, LOOP, DELIVER } step = DESCEND;
+    int prec = precedence;
+    NodePtr<Expression> value;
+    size_t value_height = 0;
+    while(true){
+        if(_too_deep){
+            _frames.resize(bottom);
+            nesting = base;
+            _height = 0;
+            return nullptr;
+        }
+        if(step == DESCEND){
+            const ParseRule &rule = parse_rules[tokens.type(cur_pos)];
+            if(rule.prefix == Prefix::NONE){
+                errors.push_back(fmt::format("{}: no prefix parse function found for {} found\n",
+                    _location(cur_pos), lexer::enum_to_string(cur_type())));
+                value = nullptr;
+                value_height = 0;
+                step = DELIVER;
+                continue;
+            }
+            if(rule.prefix == Prefix::OPERATOR){
+                auto node = _make_node<PrefixExpression>();
+                node->span = _span();
+                node->op = cur_type();
+                push(ExprFrame::EXPR, prec, nullptr, 0);
+                push(ExprFrame::PREFIX_OPERAND, 0, std::move(node), 0);
+                next_token();
+                prec = operation_prec::PREFIX;
+            }else if(rule.prefix == Prefix::GROUP){
+                push(ExprFrame::EXPR, prec, nullptr, 0);
+                push(ExprFrame::GROUP, 0, nullptr, 0);
+                next_token();
+                prec = operation_prec::LOWEST;
+            }else{
+                // if and fn set the height of what they parsed
+                _height = 1;
+                auto left = (this->*rule.leaf)();
+                // most operands are leaves: hand them over right away
+                // unless an infix operator continues the expression
+                if(_peek_tok_is(lexer::TokenType::SEMICOLON) || prec >= _peek_precedence()){
+                    value = std::move(left);
+                    value_height = _height;
+                    step = DELIVER;
+                }else{
+                    push(ExprFrame::EXPR, prec, std::move(left), _height);
+                    step = LOOP;
+                }
+            }
+            continue;
+        }
 
-unique_ptr<Expression> Parser::parse_expression(int precedence = 0){
-    auto prefix = prefix_parse_fns[cur_token.type];
-    if(prefix == nullptr){
-        errors.push_back(fmt::format("no prefix parse function found for {} found\n",
-            lexer::enum_to_string(cur_token.type)));
-        return nullptr;
-    }
-    auto left_expr = prefix();
+        if(step == LOOP){
+            ExprFrame &frame = _frames.back();
+            auto infix = parse_rules[tokens.type(cur_pos + 1)].infix;
+            if(_peek_tok_is(lexer::TokenType::SEMICOLON) ||
+                frame.precedence >= _peek_precedence() || infix == Infix::NONE){
+                value = std::move(frame.node);
+                value_height = frame.height;
+                pop();
+                step = DELIVER;
+                continue;
+            }
+            next_token();
+            if(infix == Infix::OPERATOR){
+                auto node = _make_node<InfixExpression>();
+                node->span = _span();
+                node->op = cur_type();
+                node->left = std::move(frame.node);
+                prec = _cur_precedence();
+                next_token();
+                // same shortcut as for leaves in DESCEND: an operand that
+                // ends right away becomes node->right without a frame
+                const ParseRule &rule = parse_rules[tokens.type(cur_pos)];
+                size_t left_height = frame.height;
+                if(rule.prefix == Prefix::LEAF){
+                    _height = 1;
+                    auto right = (this->*rule.leaf)();
+                    if(_peek_tok_is(lexer::TokenType::SEMICOLON) || prec >= _peek_precedence()){
+                        node->right = std::move(right);
+                        _frames.back().node = std::move(node);
+                        _frames.back().height = _tree_height(1 + std::max(left_height, _height));
+                        continue;
+                    }
+                    size_t right_height = _height;
+                    push(ExprFrame::INFIX_OPERAND, 0, std::move(node), left_height);
+                    push(ExprFrame::EXPR, prec, std::move(right), right_height);
+                    continue;
+                }
+                push(ExprFrame::INFIX_OPERAND, 0, std::move(node), left_height);
+                step = DESCEND;
+            }else{
+                auto node = _make_node<CallExpression>();
+                node->function = std::move(frame.node);
+                node->span = _span();
+                if(_peek_tok_is(lexer::TokenType::RPAREN)){
+                    next_token();
+                    frame.node = std::move(node);
+                    frame.height = _tree_height(frame.height + 1);
+                    continue;
+                }
+                next_token();
+                push(ExprFrame::CALL_ARGUMENT, 0, std::move(node), frame.height);
+                prec = operation_prec::LOWEST;
+                step = DESCEND;
+            }
+            continue;
+        }
 
-    while(!_peek_tok_is(lexer::TokenType::SEMICOLON) && precedence < _peek_precedence()){
-        auto infix = infix_parse_fns[peek_token.type];
-        if(infix == nullptr){
-            return left_expr;
+        if(_frames.size() == bottom){
+            _height = value_height;
+            return value;
+        }
+        ExprFrame &frame = _frames.back();
+        switch(frame.kind){
+            case ExprFrame::EXPR:
+                frame.node = std::move(value);
+                frame.height = value_height;
+                step = LOOP;
+                break;
+            case ExprFrame::PREFIX_OPERAND:
+                static_cast<PrefixExpression*>(frame.node.get())->right = std::move(value);
+                value = std::move(frame.node);
+                value_height = _tree_height(value_height + 1);
+                pop();
+                break;
+            case ExprFrame::INFIX_OPERAND:
+                static_cast<InfixExpression*>(frame.node.get())->right = std::move(value);
+                value = std::move(frame.node);
+                value_height = _tree_height(1 + std::max(frame.height, value_height));
+                pop();
+                break;
+            case ExprFrame::GROUP:
+                pop();
+                if(!_expect_peek(lexer::TokenType::RPAREN)){
+                    value = nullptr;
+                }
+                break;
+            case ExprFrame::CALL_ARGUMENT: {
+                auto call = static_cast<CallExpression*>(frame.node.get());
+                call->arguments.push_back(std::move(value));
+                frame.height = std::max(frame.height, value_height);
+                if(_peek_tok_is(lexer::TokenType::COMMA)){
+                    next_token();
+                    next_token();
+                    prec = operation_prec::LOWEST;
+                    step = DESCEND;
+                    break;
+                }
+                if(!_expect_peek(lexer::TokenType::RPAREN)){
+                    call->arguments.clear();
+                }
+                value = std::move(frame.node);
+                value_height = _tree_height(frame.height + 1);
+                pop();
+                break;
+            }
         }
+    }
+}
 
-        next_token();
-        left_expr = infix(std::move(left_expr));
+// past max_nesting the parse is abandoned: everything after is skipped,
+// so a huge generated input yields one error instead of one per level
+void Parser::_nesting_error(){
+    errors.push_back(fmt::format("{}: nested too deeply, the limit is {} levels",
+        _location(cur_pos), max_nesting));
+    _too_deep = true;
+    _seek(tokens.size() - 1);
+}
+
+// height of a finished node, checked against the same limit
+size_t Parser::_tree_height(size_t height){
+    if(height > max_nesting && !_too_deep){
+        _nesting_error();
     }
-    return left_expr;
+    return height;
 }
 
-unique_ptr<Expression> Parser::parse_identifier(){
-    return std::make_unique<Identifier>(cur_token, cur_token.val);
+NodePtr<Expression> Parser::parse_identifier(){
+    return _make_node<Identifier>(_span(), _symbol());
 }
 
-unique_ptr<Expression> Parser::parse_integer_literal(){
-    auto val = cur_token.val;
-    return std::make_unique<IntegerLiteral>(cur_token, stoi(val));
+NodePtr<Expression> Parser::parse_integer_literal(){
+    int64_t val;
+    if(!scan::parse_int(tokens.lexeme(cur_pos), val)){
+        errors.push_back(fmt::format("{}: could not parse {} as integer",
+            _location(cur_pos), tokens.lexeme(cur_pos)));
+        return nullptr;
+    }
+    return _make_node<IntegerLiteral>(_span(), val);
 }
 
 
-unique_ptr<Expression> Parser::parse_if_expression(){
-    auto expression = std::make_unique<IfExpression>();
-    expression->token = cur_token;
+NodePtr<Expression> Parser::parse_if_expression(){
+    auto expression = _make_node<IfExpression>();
+    expression->span = _span();
     if(!_expect_peek(lexer::TokenType::LPAREN))
         return nullptr;
     next_token();
     expression->cond = parse_expression(operation_prec::LOWEST);
+    size_t height = _height;
     if(!_expect_peek(lexer::TokenType::RPAREN))
         return nullptr;
     if(!_expect_peek(lexer::TokenType::LBRAC))
         return nullptr;
     expression->consequence = parse_block_statement(); 
+    height = std::max(height, _height);
 
     if(_peek_tok_is(lexer::TokenType::ELSE)){
         next_token();
@@ -224,62 +500,16 @@ unique_ptr<Expression> Parser::parse_if_expression(){
             return nullptr;
         }
         expression->alternative = parse_block_statement();
+        height = std::max(height, _height);
     }
 
+    _height = _tree_height(height + 1);
     return expression;
 }
 
-unique_ptr<Expression> Parser::parse_call_expression(std::unique_ptr<Expression> function){
-    auto exp = std::make_unique<CallExpression>(); 
-    exp->function = std::move(function);
-    exp->token = cur_token;
-    exp->arguments = parse_call_arguments();
-    return exp;
-}
-
-std::vector<std::unique_ptr<Expression>> Parser::parse_call_arguments(){
-    std::vector<std::unique_ptr<Expression>> args;
-    if(_peek_tok_is(lexer::TokenType::RPAREN)){
-        next_token();
-        return args;
-    }
-    next_token();
-    args.push_back(parse_expression(operation_prec::LOWEST));
-    while(_peek_tok_is(lexer::TokenType::COMMA)){
-        next_token();
-        next_token();
-        args.push_back(parse_expression(operation_prec::LOWEST));
-    }
-    if(!_expect_peek(lexer::TokenType::RPAREN)){
-        return {};
-    }
-    return args;
-}
-
-unique_ptr<Expression> Parser::parse_prefix_expression(){
-    auto expression = std::make_unique<PrefixExpression>();
-    expression->token = cur_token;
-    expression->op = cur_token.val;
-    next_token();
-    expression->right = parse_expression(operation_prec::PREFIX);
-    return expression;
-}
-
-unique_ptr<Expression> Parser::parse_infix_expression(unique_ptr<Expression> left){
-    auto expression = std::make_unique<InfixExpression>();
-    expression->token = cur_token;
-    expression->left = std::move(left);
-    expression->op = cur_token.val;
-
-    int prec = _cur_precedence();
-    next_token();
-    expression->right = parse_expression(prec);
-    return expression;
-}
-
-unique_ptr<ExpressionStatement> Parser::parse_expression_statement(){
-    auto stmt = std::make_unique<ExpressionStatement>();
-    stmt->expr_token = cur_token;
+NodePtr<ExpressionStatement> Parser::parse_expression_statement(){
+    auto stmt = _make_node<ExpressionStatement>();
+    stmt->span = _span();
     stmt->expr = parse_expression();
     if(_peek_tok_is(lexer::TokenType::SEMICOLON)){
         next_token();
@@ -287,54 +517,70 @@ unique_ptr<ExpressionStatement> Parser::parse_expression_statement(){
     return stmt;
 }
 
-unique_ptr<BlockStatement> Parser::parse_block_statement(){
-    auto block = std::make_unique<BlockStatement>();
-    block->token = cur_token;
+// blocks nest through if and fn, which still recurse on the native
+// stack, so they count towards max_nesting as well
+NodePtr<BlockStatement> Parser::parse_block_statement(){
+    auto block = _make_node<BlockStatement>();
+    block->span = _span();
+    if(++nesting > max_nesting){
+        _nesting_error();
+    }
     next_token();
+    size_t height = 0;
     while(!_cur_tok_is(lexer::TokenType::RBRAC) && !_cur_tok_is(lexer::TokenType::ENDOF)){
         auto stmt = parse_statement();
         if(stmt != nullptr){
             block->statements.push_back(std::move(stmt));
         }
+        height = std::max(height, _height);
         next_token(); // eating semi-colon
     }
+    nesting--;
+    _height = height + 1;
     return block;
 }
 
-unique_ptr<Statement> Parser::parse_statement(){
-    switch(cur_token.type){
-        case lexer::TokenType::LET: return parse_let_statement();
-        case lexer::TokenType::RETURN: return parse_ret_statement();
-        default: return parse_expression_statement();
+NodePtr<Statement> Parser::parse_statement(){
+    _height = 0;
+    NodePtr<Statement> stmt;
+    switch(cur_type()){
+        case lexer::TokenType::LET: stmt = parse_let_statement(); break;
+        case lexer::TokenType::RETURN: stmt = parse_ret_statement(); break;
+        default: stmt = parse_expression_statement();
     }
+    // one level above its expression
+    _height++;
+    return stmt;
 }
 
-unique_ptr<Program> Parser::parse_program(){
-    auto program = std::make_unique<Program>();
-    while(cur_token.type != lexer::TokenType::ENDOF){
+NodePtr<Program> Parser::parse_program(){
+    auto program = make_node<Program>(nullptr);
+    program->arena = arena;
+    while(cur_type() != lexer::TokenType::ENDOF){
         auto stmt = parse_statement();
         if(stmt != nullptr){
             program->statements.push_back(std::move(stmt));
         }
         next_token();
     }
+    resolver::resolve(*program);
     return program;
 }
 
-std::vector<std::unique_ptr<Identifier>> Parser::parse_function_call_parameters(){
-    std::vector<std::unique_ptr<Identifier>> identifiers;
+std::vector<NodePtr<Identifier>> Parser::parse_function_call_parameters(){
+    std::vector<NodePtr<Identifier>> identifiers;
     if(_peek_tok_is(lexer::TokenType::RPAREN)){
         next_token();
         return identifiers;
     }
     next_token();
-    auto ident = std::make_unique<Identifier>(cur_token, cur_token.val);
+    auto ident = _make_node<Identifier>(_span(), _symbol());
     identifiers.push_back(std::move(ident));
 
     while(_peek_tok_is(lexer::TokenType::COMMA)){
         next_token();
         next_token();
-        auto ident = std::make_unique<Identifier>(cur_token,cur_token.val );
+        auto ident = _make_node<Identifier>(_span(), _symbol());
         identifiers.push_back(std::move(ident));
     }
     if(!_expect_peek(lexer::TokenType::RPAREN)){
@@ -344,8 +590,10 @@ std::vector<std::unique_ptr<Identifier>> Parser::parse_function_call_parameters(
     return identifiers;
 }
 
-unique_ptr<Expression> Parser::parse_function_literal(){
-    auto lit = std::make_unique<FunctionLiteral>();
+NodePtr<Expression> Parser::parse_function_literal(){
+    auto lit = _make_node<FunctionLiteral>();
+    lit->span = _span();
+    lit->arena = arena;
     if(!_expect_peek(lexer::TokenType::LPAREN)){
         return nullptr;
     }
@@ -353,10 +601,62 @@ unique_ptr<Expression> Parser::parse_function_literal(){
     if(!_expect_peek(lexer::TokenType::LBRAC)){
         return nullptr;
     }
-    lit->body = parse_block_statement();
+    // an unbalanced body is parsed right away, for the usual error
+    size_t end = lazy_bodies ? _matching_brace(cur_pos) : 0;
+    if(end == 0){
+        lit->body = parse_block_statement();
+        _height = _tree_height(_height + 1);
+        return lit;
+    }
+    if(shared->source.data() != tokens.source.data()){
+        shared->source = std::string(tokens.source);
+        tokens.source = shared->source;
+    }
+    lit->lazy_tokens = shared;
+    lit->body_pos = cur_pos;
+    _seek(end);
     return lit;
 }
 
+// index of the `}` closing the `{` at pos, or 0 if the input ends first.
+// only looks at token types, no nodes or token strings are made
+size_t Parser::_matching_brace(size_t pos){
+    size_t depth = 0;
+    for(size_t i = pos; i < tokens.size(); i++){
+        auto type = tokens.type(i);
+        if(type == lexer::TokenType::LBRAC){
+            depth++;
+        }else if(type == lexer::TokenType::RBRAC && --depth == 0){
+            return i;
+        }
+    }
+    return 0;
+}
+
+bool FunctionLiteral::parse_body() const {
+    if(body != nullptr){
+        return true;
+    }
+    if(lazy_tokens == nullptr){
+        return false;
+    }
+    // nested functions stay lazy, and the new nodes go into the arena of
+    // this literal (or the heap, like the literal itself)
+    Parser p(lazy_tokens, body_pos, arena.lock());
+    p.lazy_bodies = true;
+    p.heap_nodes = !arena_owned;
+    auto block = p.parse_block_statement();
+    if(p.errors.empty()){
+        body = std::move(block);
+        resolver::resolve_body(*this);
+    }else{
+        body_errors = std::move(p.errors);
+    }
+    // either way there is nothing left to parse
+    lazy_tokens = nullptr;
+    return body != nullptr;
+}
+
 
 std::string Program::string() const{
     std::string program_string = "";
@@ -405,11 +705,11 @@ std::string ExpressionStatement::string() const {
 }
 
 std::string Identifier::string() const {
-    return value;
+    return name();
 }
 
 std::string IntegerLiteral::string() const {
-    return token.val;
+    return token_literal();
 }
 
 std::string FunctionLiteral::string() const {
@@ -424,13 +724,15 @@ std::string FunctionLiteral::string() const {
     }
 
     fn_lit_str += "){\n";
-    fn_lit_str += body->string();
+    if(parse_body()){
+        fn_lit_str += body->string();
+    }
     fn_lit_str += "\n}";
     return fn_lit_str;
 }
 
 std::string Boolean::string() const {
-    return token.val;
+    return token_literal();
 }
 
 std::string CallExpression::string() const {
@@ -463,7 +765,7 @@ std::string PrefixExpression::string() const {
     std::string pref_expr_string = "";
     pref_expr_string += "(";
     // pref_expr_string += " " + op + " ";
-    pref_expr_string += op;
+    pref_expr_string += lexer::token_spelling(op);
     pref_expr_string += right->string();
     pref_expr_string += ")";
     return pref_expr_string;
@@ -473,95 +775,114 @@ std::string InfixExpression::string() const {
     std::string inf_expr_string = "";
     inf_expr_string += "(";
     inf_expr_string += left->string();
-    inf_expr_string += " " + op + " ";
+    inf_expr_string += " ";
+    inf_expr_string += lexer::token_spelling(op);
+    inf_expr_string += " ";
     inf_expr_string += right->string();
     inf_expr_string += ")";
     return inf_expr_string;
 }
 
-std::unique_ptr<Statement> BlockStatement::clone() const {
-    auto block_stmt = std::make_unique<BlockStatement>();
-    block_stmt->token = token;
+NodePtr<Statement> BlockStatement::clone() const {
+    auto block_stmt = make_node<BlockStatement>(nullptr);
+    block_stmt->span = span;
     for(int i=0; i<statements.size(); i++){
         block_stmt->statements.push_back(statements[i]->clone());
     }
     return block_stmt;
 }
 
-std::unique_ptr<Statement> LetStatement::clone() const {
-    auto let_stmt = std::make_unique<LetStatement>();
-    let_stmt->let_token = let_token;
+NodePtr<Statement> LetStatement::clone() const {
+    auto let_stmt = make_node<LetStatement>(nullptr);
+    let_stmt->span = span;
     let_stmt->name = 
-        std::unique_ptr<Identifier>(static_cast<Identifier*>(name->clone().release()));
+        NodePtr<Identifier>(static_cast<Identifier*>(name->clone().release()));
     let_stmt->value = value->clone();
     return let_stmt;
 }
 
-std::unique_ptr<Statement> ReturnStatement::clone() const {
-    auto ret_stmt = std::make_unique<ReturnStatement>();
-    ret_stmt->ret_token = ret_token;
+NodePtr<Statement> ReturnStatement::clone() const {
+    auto ret_stmt = make_node<ReturnStatement>(nullptr);
+    ret_stmt->span = span;
     ret_stmt->return_value = return_value->clone();
     return ret_stmt;
 }
 
-std::unique_ptr<Statement> ExpressionStatement::clone() const {
-    auto expr_stmt = std::make_unique<ExpressionStatement>();
-    expr_stmt->expr_token = expr_token;
+NodePtr<Statement> ExpressionStatement::clone() const {
+    auto expr_stmt = make_node<ExpressionStatement>(nullptr);
+    expr_stmt->span = span;
     expr_stmt->expr = expr->clone();
     return expr_stmt;
 }
 
-std::unique_ptr<Expression> Identifier::clone() const {
-    return std::make_unique<Identifier>(token, value);
+NodePtr<Expression> Identifier::clone() const {
+    auto id = make_node<Identifier>(nullptr, span, sym);
+    id->depth = depth;
+    id->slot = slot;
+    return id;
 }
 
-std::unique_ptr<Expression> IntegerLiteral::clone() const {
-    return std::make_unique<IntegerLiteral>(token, val);
+NodePtr<Expression> IntegerLiteral::clone() const {
+    return make_node<IntegerLiteral>(nullptr, span, val);
 }
 
-std::unique_ptr<Expression> Boolean::clone() const {
-    return std::make_unique<Boolean>(token, val);
+NodePtr<Expression> Boolean::clone() const {
+    return make_node<Boolean>(nullptr, span, val);
 }
 
-std::unique_ptr<Expression> PrefixExpression::clone() const {
-    auto prefix_expr = std::make_unique<PrefixExpression>();
-    prefix_expr->token = token;
+NodePtr<Expression> PrefixExpression::clone() const {
+    auto prefix_expr = make_node<PrefixExpression>(nullptr);
+    prefix_expr->span = span;
     prefix_expr->op = op;
     prefix_expr->right = right->clone();
     return prefix_expr;
 }
 
-std::unique_ptr<Expression> InfixExpression::clone() const {
-    auto infix_expr = std::make_unique<InfixExpression>();
-    infix_expr->token = token;
+NodePtr<Expression> InfixExpression::clone() const {
+    auto infix_expr = make_node<InfixExpression>(nullptr);
+    infix_expr->span = span;
     infix_expr->left = left->clone();
     infix_expr->op = op;
     infix_expr->right = right->clone();
     return infix_expr;
 }
 
-std::unique_ptr<Expression> FunctionLiteral::clone() const {
-    auto fn_expr = std::make_unique<FunctionLiteral>();
-    fn_expr->token = token;
-    fn_expr->body = 
-        std::unique_ptr<BlockStatement>(static_cast<BlockStatement*>(body->clone().release()));
+NodePtr<Expression> FunctionLiteral::clone() const {
+    auto fn_expr = make_node<FunctionLiteral>(nullptr);
+    fn_expr->span = span;
+    fn_expr->arena = arena;
+    for(auto &param : parameters){
+        fn_expr->parameters.push_back(NodePtr<Identifier>(
+            static_cast<Identifier*>(param->clone().release())));
+    }
+    if(body != nullptr){
+        fn_expr->body = 
+            NodePtr<BlockStatement>(static_cast<BlockStatement*>(body->clone().release()));
+    }
+    fn_expr->lazy_tokens = lazy_tokens;
+    fn_expr->body_pos = body_pos;
+    fn_expr->body_errors = body_errors;
+    fn_expr->frame_size = frame_size;
+    fn_expr->scope = scope;
     return fn_expr;
 }
 
-std::unique_ptr<Expression> IfExpression::clone() const {
-    auto if_expr = std::make_unique<IfExpression>();
-    if_expr->token = token;
+NodePtr<Expression> IfExpression::clone() const {
+    auto if_expr = make_node<IfExpression>(nullptr);
+    if_expr->span = span;
     if_expr->cond = cond->clone();
     if_expr->consequence = 
-        std::unique_ptr<BlockStatement>(static_cast<BlockStatement*>(consequence->clone().release()));
-    if_expr->alternative = 
-        std::unique_ptr<BlockStatement>(static_cast<BlockStatement*>(alternative->clone().release()));
+        NodePtr<BlockStatement>(static_cast<BlockStatement*>(consequence->clone().release()));
+    if(alternative != nullptr){
+        if_expr->alternative = 
+            NodePtr<BlockStatement>(static_cast<BlockStatement*>(alternative->clone().release()));
+    }
     return if_expr;
 }
 
-std::unique_ptr<Expression> CallExpression::clone() const {
-    auto call_expr = std::make_unique<CallExpression>();
-    call_expr->token = token;
+NodePtr<Expression> CallExpression::clone() const {
+    auto call_expr = make_node<CallExpression>(nullptr);
+    call_expr->span = span;
     call_expr->function = function->clone();
     for(int i=0; i<arguments.size(); i++){
         call_expr->arguments.push_back(std::move(arguments[i]->clone()));
@@ -570,17 +891,7 @@ std::unique_ptr<Expression> CallExpression::clone() const {
     return call_expr;
 }
 
-void Parser::register_prefix(lexer::TokenType token_type,
-    std::function<std::unique_ptr<Expression>()> fn){
-    prefix_parse_fns[token_type] = fn;
-}
-
-void Parser::register_infix(lexer::TokenType token_type,
-    std::function<std::unique_ptr<Expression>(std::unique_ptr<Expression>)> fn){
-    infix_parse_fns[token_type] = fn;
-}
-
-bool test_integer_integral(std::unique_ptr<Expression> il, int64_t value){
+bool test_integer_integral(NodePtr<Expression> il, int64_t value){
     const IntegerLiteral* integ = dynamic_cast<IntegerLiteral*>(il.get());
     if(integ == nullptr){
         printf("[error] did not recieve integer literal expression\n");
@@ -597,13 +908,13 @@ bool test_integer_integral(std::unique_ptr<Expression> il, int64_t value){
     return true;
 }
 
-bool test_identifier(std::unique_ptr<Expression> exp, std::string value){
+bool test_identifier(NodePtr<Expression> exp, std::string value){
     const Identifier* ident = dynamic_cast<Identifier*>(exp.get());
     if(ident == nullptr){
         printf("[error] did not recieve identifier expression\n");
         return false;
     }
-    if(ident->value != value){
+    if(ident->name() != value){
         printf("[error] id value mismatch\n");
         return false;
     }
@@ -614,7 +925,7 @@ bool test_identifier(std::unique_ptr<Expression> exp, std::string value){
     return true;
 }
 
-bool test_boolean_literal(std::unique_ptr<Expression> exp, bool value){
+bool test_boolean_literal(NodePtr<Expression> exp, bool value){
     const Boolean* bo = dynamic_cast<Boolean*>(exp.get());
     if(bo == nullptr){
         printf("[error] expected boolean expression but go something else\n");
@@ -637,7 +948,7 @@ bool test_boolean_literal(std::unique_ptr<Expression> exp, bool value){
     return true;
 }
 
-bool test_literal_expression(std::unique_ptr<Expression> exp, const std::any& expected){
+bool test_literal_expression(NodePtr<Expression> exp, const std::any& expected){
     if(expected.type() == typeid(int)){
         return test_integer_integral(std::move(exp), (int64_t)std::any_cast<int>(expected));
     }else if(expected.type() == typeid(int64_t)){
@@ -654,7 +965,7 @@ bool test_literal_expression(std::unique_ptr<Expression> exp, const std::any& ex
     return false;
 }
 
-bool test_infix_expression(std::unique_ptr<Expression> exp, 
+bool test_infix_expression(NodePtr<Expression> exp, 
     const std::any &left, std::string op, const std::any &right){
     const InfixExpression* op_exp = dynamic_cast<InfixExpression*>(exp.get());
     if(op_exp == nullptr){
@@ -662,14 +973,14 @@ bool test_infix_expression(std::unique_ptr<Expression> exp,
         return false;
     }
 
-    std::unique_ptr<InfixExpression> inf_expr = 
-        std::unique_ptr<InfixExpression>(dynamic_cast<InfixExpression*>(exp.release()));
+    NodePtr<InfixExpression> inf_expr = 
+        NodePtr<InfixExpression>(dynamic_cast<InfixExpression*>(exp.release()));
 
     if(!test_literal_expression(std::move(inf_expr->left), left)){
         return false;
     }
 
-    if(inf_expr->op != op){
+    if(lexer::token_spelling(inf_expr->op) != op){
         printf("[error] operator mismatch \n");
         return false;
     }
@@ -694,7 +1005,7 @@ void check_parse_errors(vector<std::string> errors){
     return;
 }
 
-bool test_let_statement(std::unique_ptr<Statement> s, std::string id){
+bool test_let_statement(NodePtr<Statement> s, std::string id){
     if(s->token_literal() != "let"){
         printf("expected to get `let` but got %s\n", s->token_literal().c_str());
         return false;
@@ -706,10 +1017,10 @@ bool test_let_statement(std::unique_ptr<Statement> s, std::string id){
         return false;
     }
 
-    if(let_statment->name->value != id){
+    if(let_statment->name->name() != id){
         printf("letstatement id is different, expected %s, got %s\n", 
             id.c_str(),
-            let_statment->name->value.c_str());
+            let_statment->name->name().c_str());
         return false;
     }
     return true;
@@ -786,9 +1097,9 @@ return 993322;
             return;
         }
 
-        if(stmt->ret_token.val != "return"){
+        if(stmt->token_literal() != "return"){
             printf("returnstmt.token is 'return', but got %s\n", 
-                stmt->ret_token.val.c_str());
+                stmt->token_literal().c_str());
             return;
         }
     }
@@ -797,15 +1108,16 @@ return 993322;
 }
 
 void test_string(){
-    auto stmt = std::make_unique<LetStatement>();
-    stmt->let_token = lexer::Token(lexer::TokenType::LET, "let"); 
-    stmt->name = std::make_unique<Identifier>(
-        lexer::Token(lexer::TokenType::ID, "my_var"), 
-        "my_var");
-    stmt->value = std::make_unique<Identifier>(
-        lexer::Token(lexer::TokenType::ID, "another_var"), 
-        "another_var");
     Program program;
+    program.arena = std::make_shared<AstArena>();
+    auto stmt = make_node<LetStatement>(nullptr);
+    stmt->span = program.arena->span(lexer::TokenType::LET, "let"); 
+    stmt->name = make_node<Identifier>(nullptr, 
+        program.arena->span(lexer::TokenType::ID, "my_var"), 
+        lexer::intern("my_var"));
+    stmt->value = make_node<Identifier>(nullptr, 
+        program.arena->span(lexer::TokenType::ID, "another_var"), 
+        lexer::intern("another_var"));
     program.statements.push_back(std::move(stmt));
 
     if(program.string() != "let my_var = another_var;"){
@@ -841,13 +1153,13 @@ void test_identifier_expression(){
         return;
     }
 
-    if(ident->value != "foobar"){
-        printf("ident not %s, got %s\n", "foobar", ident->value.c_str());
+    if(ident->name() != "foobar"){
+        printf("ident not %s, got %s\n", "foobar", ident->name().c_str());
         return;
     }
 
     if(ident->token_literal() != "foobar"){
-        printf("ident.token_literal not %s, got %s\n", "foobar", ident->value.c_str());
+        printf("ident.token_literal not %s, got %s\n", "foobar", ident->token_literal().c_str());
         return;
     }
 
@@ -932,12 +1244,12 @@ void test_parsing_prefix_expression(){
             printf("[error] statement is not prefix expression\n");
             return;
         }
-        if(exp->op != prefix_tests[i].op){
+        if(lexer::token_spelling(exp->op) != prefix_tests[i].op){
             printf("[error] operator mismatch actual is '%s' but got %s\n", prefix_tests[i].op.c_str(), 
-                exp->op.c_str());
+                std::string(lexer::token_spelling(exp->op)).c_str());
             return;
         }
-        std::unique_ptr<Expression> right = std::move(exp->right);
+        NodePtr<Expression> right = std::move(exp->right);
 
         if(!test_literal_expression(std::move(right), prefix_tests[i].val)){
             return;
@@ -994,13 +1306,13 @@ void test_parsing_infix_expression(){
             return;
         }
 
-        std::unique_ptr<Expression> left_expr = std::move(inf_expr->left);
-        std::unique_ptr<Expression> right_expr = std::move(inf_expr->right);
+        NodePtr<Expression> left_expr = std::move(inf_expr->left);
+        NodePtr<Expression> right_expr = std::move(inf_expr->right);
         if(!test_literal_expression(std::move(left_expr), infix_tests[i].left_value)){
             return;
         }
 
-        if(inf_expr->op != infix_tests[i].op){
+        if(lexer::token_spelling(inf_expr->op) != infix_tests[i].op){
             printf("[error] infix operator mismatch\n");
             return;
         }
@@ -1149,4 +1461,126 @@ void test_call_expression(){
     return;
 }
 
-}
\ No newline at end of file
+void test_arena_teardown(){
+    int passed = 0;
+    int total = 0;
+    auto check = [&](bool cond, const std::string &what){
+        total++;
+        if(!cond){
+            printf("[error] arena teardown: %s\n", what.c_str());
+            return;
+        }
+        passed++;
+    };
+    // a node that counts how often it is destroyed
+    struct Probe : IntegerLiteral {
+        int *destroyed;
+        Probe(int *destroyed)
+            : IntegerLiteral(NO_SPAN, 0), destroyed(destroyed) {}
+        ~Probe() override { (*destroyed)++; }
+    };
+
+    // a heap node under an arena node goes with the arena, and an arena
+    // node under that heap node is left to the arena
+    int heap_child = 0;
+    int arena_child = 0;
+    auto arena = std::make_shared<AstArena>();
+    auto stmt = make_node<ExpressionStatement>(arena.get());
+    stmt->expr = make_node<Probe>(nullptr, &heap_child);
+    auto prefix = make_node<PrefixExpression>(nullptr);
+    prefix->right = make_node<Probe>(arena.get(), &arena_child);
+    auto outer = make_node<ExpressionStatement>(arena.get());
+    outer->expr = std::move(prefix);
+    check(arena->owns(stmt.get()) && !arena->owns(stmt->expr.get()), "owns");
+    stmt = nullptr;
+    outer = nullptr;
+    check(heap_child == 0 && arena_child == 0, "arena nodes left to the arena");
+    arena = nullptr;
+    check(heap_child == 1, "heap child freed with the arena");
+    check(arena_child == 1, "arena node under a heap node destroyed once");
+
+    // a dropped heap node leaves its arena children alone
+    arena_child = 0;
+    arena = std::make_shared<AstArena>();
+    prefix = make_node<PrefixExpression>(nullptr);
+    prefix->right = make_node<Probe>(arena.get(), &arena_child);
+    prefix = nullptr;
+    check(arena_child == 0, "arena child outlives its heap parent");
+    arena = nullptr;
+    check(arena_child == 1, "arena child destroyed by its arena");
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+void test_deep_nesting(){
+    int passed = 0;
+    int total = 0;
+    auto check = [&](bool cond, const std::string &what){
+        total++;
+        if(!cond){
+            printf("[error] deep nesting: %s\n", what.c_str());
+            return;
+        }
+        passed++;
+    };
+    auto parse = [](const std::string &input, size_t max_nesting){
+        lexer::Lexer l(input);
+        auto p = Parser(l);
+        p.max_nesting = max_nesting;
+        auto program = p.parse_program();
+        return std::make_pair(std::move(program), p.errors);
+    };
+
+    // far deeper than the native stack would allow for a recursive parser
+    size_t n = 200000;
+    auto [parens, parens_errors] = parse(std::string(n, '(') + "1" + std::string(n, ')'), n);
+    check(parens_errors.empty() && parens->string() == "1", "nested parentheses");
+
+    std::string chain = "a";
+    for(size_t i = 0; i < n; i++){
+        chain += " + a";
+    }
+    // a left-leaning chain only ever waits for one operand, but it is as
+    // tall as it is long
+    auto [sum, sum_errors] = parse(chain, n + 1);
+    size_t spine = 0;
+    auto stmt = sum->statements.empty() ? nullptr
+        : dynamic_cast<ExpressionStatement*>(sum->statements[0].get());
+    for(auto exp = stmt ? stmt->expr.get() : nullptr;
+        auto infix = dynamic_cast<InfixExpression*>(exp); exp = infix->left.get()){
+        spine++;
+    }
+    check(sum_errors.empty() && spine == n, "long chain is not one left-leaning tree");
+    auto [tall, tall_errors] = parse("1 + 1 + 1 + 1 + 1; 2", 4);
+    check(tall_errors.size() == 1 &&
+        tall_errors[0] == "1:17: nested too deeply, the limit is 4 levels",
+        "chain taller than the limit");
+
+    std::string calls;
+    for(size_t i = 0; i < 1000; i++){
+        calls += "f(1, ";
+    }
+    calls += "-x" + std::string(1000, ')');
+    // 1000 calls around -x, a tree 1002 levels tall
+    auto [nested_calls, call_errors] = parse(calls, 1002);
+    check(call_errors.empty(), "nested calls");
+
+    // one error past the limit, and nothing parsed after it
+    auto [deep, deep_errors] = parse(std::string(11, '-') + "1; 2", 10);
+    check(deep_errors.size() == 1 &&
+        deep_errors[0] == "1:11: nested too deeply, the limit is 10 levels",
+        "prefix operators past the limit");
+    auto [blocks, block_errors] = parse("if (a) { if (b) { if (c) { 1 } } }", 2);
+    check(block_errors.size() == 1, "blocks past the limit");
+    auto [at_limit, limit_errors] = parse("((((1))))", 4);
+    check(limit_errors.empty(), "parentheses at the limit");
+
+    // malformed input reports what the recursive parser reported
+    auto [open, open_errors] = parse("(1 + 2", 10);
+    check(open_errors.size() == 1 &&
+        open_errors[0] == "1:7: expected next token to be RPAREN, got ENDOF instead",
+        "unclosed parenthesis");
+    auto [args, args_errors] = parse("f(1, 2", 10);
+    check(args_errors.size() == 1, "unclosed call");
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+}
@@ -1,3 +1,6 @@
+#ifndef PARSER_H
+#define PARSER_H
+
 #include <algorithm>
 #include <cstdint>
 #include <string>
@@ -5,261 +8,422 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
-#include <functional>
+#include <new>
 #include "lexer.h"
 
+namespace resolver {
+struct Scope;
+}
 
 namespace parser {
 
+// nodes do not carry their token. each keeps a 32-bit span id into a side
+// table holding the token's type and lexeme, which is only looked at to
+// print a node (string(), token_literal()) or report an error. spans are
+// made by AstArena::span and live as long as the arena
+constexpr uint32_t NO_SPAN = 0;
+
+struct SpanEntry {
+    const char *text;
+    uint32_t length;
+    lexer::TokenType type;
+};
+
+std::string_view span_text(uint32_t span);
+lexer::TokenType span_type(uint32_t span);
 
 struct Node {
-    virtual std::string token_literal() const = 0;
+    // set for nodes placed in an AstArena
+    bool arena_owned = false;
+    uint32_t span = NO_SPAN;
+
+    virtual std::string token_literal() const { return std::string(span_text(span)); }
     virtual std::string string() const = 0;
     virtual ~Node() {};
 };
 
+// bump allocator for the nodes of one parse. nodes are packed into large
+// blocks and torn down in a single pass when the last Program or Function
+// holding the arena is dropped, instead of one free per node. children of
+// an arena node must come from the same arena. every parse has one, also
+// for heap nodes, since it owns the spans of the tree
+struct AstArena {
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    static constexpr uint32_t SPAN_PAGE_BITS = 12;
+    static constexpr uint32_t SPAN_PAGE_SIZE = 1u << SPAN_PAGE_BITS;
+    // the arena running its destructors, see NodeDeleter
+    static inline thread_local const AstArena *releasing = nullptr;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    // [begin, end) of each block, sorted on teardown for owns()
+    std::vector<std::pair<uintptr_t, uintptr_t>> block_ranges;
+    char *cur = nullptr;
+    char *end = nullptr;
+    std::vector<Node*> nodes;
+    // pages of the span table handed to this arena, see span()
+    std::vector<uint32_t> span_pages;
+    SpanEntry *span_page = nullptr;
+    uint32_t next_span = 0;
+    uint32_t span_end = 0;
+
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena &operator=(const AstArena&) = delete;
+    ~AstArena();
+
+    void *allocate(size_t size, size_t align);
+    // whether node lies in one of the blocks, without reading it
+    bool owns(const void *node) const;
+    // new span for a token. operators and keywords point at their fixed
+    // spelling, any other text is copied into the arena
+    uint32_t span(lexer::TokenType type, std::string_view text){
+        if(next_span == span_end){
+            _span_page();
+        }
+        std::string_view spelling = lexer::token_spelling(type);
+        const char *stored = spelling.data();
+        if(spelling.empty()){
+            char *copy = static_cast<char*>(allocate(text.size(), 1));
+            std::copy(text.begin(), text.end(), copy);
+            stored = copy;
+        }
+        span_page[next_span & (SPAN_PAGE_SIZE - 1)] = {stored, uint32_t(text.size()), type};
+        return next_span++;
+    }
+    void _span_page();
+
+    template <typename T, typename... Args>
+    T *make(Args&&... args){
+        T *node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        node->arena_owned = true;
+        nodes.push_back(node);
+        return node;
+    }
+};
+
+// deleter of the pointers between nodes. only heap nodes are deleted; an
+// arena node belongs to its arena, which destroys them all at once. while
+// an arena tears down, a child may already be destroyed, so the child is
+// told apart by address rather than by its arena_owned flag: a heap node
+// hung under an arena node is still deleted with it
+struct NodeDeleter {
+    void operator()(Node *node) const {
+        const AstArena *arena = AstArena::releasing;
+        if(arena != nullptr ? arena->owns(node) : node->arena_owned){
+            return;
+        }
+        delete node;
+    }
+};
+
+template <typename T>
+using NodePtr = std::unique_ptr<T, NodeDeleter>;
+
+// allocates a node in arena, or on the heap when arena is null
+template <typename T, typename... Args>
+NodePtr<T> make_node(AstArena *arena, Args&&... args){
+    if(arena == nullptr){
+        return NodePtr<T>(new T(std::forward<Args>(args)...));
+    }
+    return NodePtr<T>(arena->make<T>(std::forward<Args>(args)...));
+}
 
 // abstract class for all the statements
 struct Statement : public Node {
     virtual void statement_node() const = 0;
     virtual ~Statement() {}
-    virtual std::unique_ptr<Statement> clone() const = 0;
+    virtual NodePtr<Statement> clone() const = 0;
 };
 
 struct Expression : public Node {
     virtual void expression_node() const = 0;
-    virtual std::unique_ptr<Expression> clone() const = 0;
+    virtual NodePtr<Expression> clone() const = 0;
     virtual ~Expression() {}
 };
 
 struct Identifier : Expression {
-    lexer::Token token;
-    std::string value;
-
-    Identifier(lexer::Token token, std::string value) : token(token), value(value){}
+    // interned name, see lexer::intern
+    uint32_t sym;
+    // where the variable lives, set by the resolver (resolver.h): the
+    // environment depth levels out, and the slot in it
+    uint32_t depth = 0;
+    uint32_t slot;
+
+    Identifier(uint32_t span, uint32_t sym) : sym(sym), slot(sym) { this->span = span; }
+    const std::string &name() const { return lexer::symbol_name(sym); }
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct IntegerLiteral : Expression {
-    lexer::Token token;
     int64_t val;
 
-    IntegerLiteral(lexer::Token token, int64_t val) : token(token), val(val){}
+    IntegerLiteral(uint32_t span, int64_t val) : val(val) { this->span = span; }
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 
 struct Boolean : Expression {
-    lexer::Token token;
     bool val;
 
-    Boolean(lexer::Token token, bool val) : token(token), val(val) {};
+    Boolean(uint32_t span, bool val) : val(val) { this->span = span; }
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct PrefixExpression : Expression {
-    lexer::Token token;
-    std::string op;
-    std::unique_ptr<Expression> right;
+    lexer::TokenType op;
+    NodePtr<Expression> right;
 
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct InfixExpression : Expression {
-    lexer::Token token;
-    std::unique_ptr<Expression> left;
-    std::string op;
-    std::unique_ptr<Expression> right;
+    lexer::TokenType op;
+    NodePtr<Expression> left;
+    NodePtr<Expression> right;
 
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct BlockStatement : Statement {
-    lexer::Token token;
-    vector<std::unique_ptr<Statement>> statements;
+    vector<NodePtr<Statement>> statements;
     void statement_node() const override {} 
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Statement> clone() const override;
+    NodePtr<Statement> clone() const override;
+};
+
+// token stream of one parse. a lazy parse shares it with the function
+// bodies it skipped, so they can be parsed from it on their first call
+struct SourceTokens {
+    // copy of the script, taken when the first body is skipped, since a
+    // body may be parsed long after the caller's input is gone
+    std::string source;
+    lexer::TokenBuffer tokens;
 };
 
 struct FunctionLiteral : Expression {
-    lexer::Token token;
-    std::vector<std::unique_ptr<Identifier>> parameters;
-    std::unique_ptr<BlockStatement> body;
+    // lets a Function object keep the body's arena (nodes and spans) alive
+    // after the Program
+    std::weak_ptr<AstArena> arena;
+    std::vector<NodePtr<Identifier>> parameters;
+    // null until parse_body() for a body skipped by a lazy parse, which
+    // leaves the tokens it came from and the index of its `{` instead.
+    // mutable because the first call may parse it through a const tree
+    mutable NodePtr<BlockStatement> body;
+    mutable std::shared_ptr<SourceTokens> lazy_tokens;
+    mutable size_t body_pos = 0;
+    mutable std::vector<std::string> body_errors;
+    // slots in a call's environment, set by the resolver; until a skipped
+    // body is parsed, the scopes it is resolved in
+    mutable uint32_t frame_size = 0;
+    mutable std::shared_ptr<const resolver::Scope> scope;
+
+    // parses a skipped body, once. true if body is set; otherwise
+    // body_errors holds the parser's messages
+    bool parse_body() const;
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct IfExpression : Expression {
-    lexer::Token token; // if token
-    std::unique_ptr<Expression> cond;
-    std::unique_ptr<BlockStatement> consequence;
-    std::unique_ptr<BlockStatement> alternative;
+    NodePtr<Expression> cond;
+    NodePtr<BlockStatement> consequence;
+    NodePtr<BlockStatement> alternative;
 
     void expression_node() const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 struct CallExpression : Expression {
-    lexer::Token token;
-    std::unique_ptr<Expression> function;
-    std::vector<std::unique_ptr<Expression>> arguments;
+    NodePtr<Expression> function;
+    std::vector<NodePtr<Expression>> arguments;
 
     void expression_node() const override{}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Expression> clone() const override;
+    NodePtr<Expression> clone() const override;
 };
 
 // syntax:
 // let-statement := <let> <name> `=` <expression> 
 struct LetStatement : Statement {
-    lexer::Token let_token;
-    std::unique_ptr<Identifier> name;
-    std::unique_ptr<Expression> value;
+    NodePtr<Identifier> name;
+    NodePtr<Expression> value;
 
     void statement_node() const override{}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Statement> clone() const override;
+    NodePtr<Statement> clone() const override;
 };
 
 struct ReturnStatement : Statement {
-    lexer::Token ret_token;
-    std::unique_ptr<Expression> return_value;
+    NodePtr<Expression> return_value;
 
     void statement_node () const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Statement> clone() const override;
+    NodePtr<Statement> clone() const override;
 };
 
 struct ExpressionStatement : Statement {
-    lexer::Token expr_token; // first token in the expression
-    std::unique_ptr<Expression> expr;
+    // span is the first token in the expression
+    NodePtr<Expression> expr;
 
     void statement_node () const override {}
-    std::string token_literal() const override;
     std::string string() const override;
-    std::unique_ptr<Statement> clone() const override;
+    NodePtr<Statement> clone() const override;
 };
 
 struct Program : Node {
-    vector<unique_ptr<Statement>> statements;
-    std::string token_literal() const {
+    // declared first so it outlives the statements
+    std::shared_ptr<AstArena> arena;
+    vector<NodePtr<Statement>> statements;
+    std::string token_literal() const override {
         return (!statements.empty()) ? statements[0]->token_literal() : "";
     }
     std::string string() const;
 };
 
-std::unique_ptr<Expression> prefix_parse_fn();
-std::unique_ptr<Expression> infix_parse_fn(std::unique_ptr<Expression>);
+// pending work of the explicit-stack expression parser, see
+// Parser::parse_expression
+struct ExprFrame {
+    enum Kind : uint8_t {
+        // a parse_expression(precedence) call; node is its left operand
+        EXPR,
+        // waiting for the operand of node
+        PREFIX_OPERAND,
+        INFIX_OPERAND,
+        CALL_ARGUMENT,
+        // waiting for the expression inside `(`
+        GROUP,
+    };
+    Kind kind;
+    int precedence;
+    NodePtr<Expression> node;
+    // height of node, of node->left for INFIX_OPERAND and of the tallest
+    // of function and arguments so far for CALL_ARGUMENT
+    size_t height = 0;
+};
 
 struct Parser {
-    lexer::Lexer l;
-    lexer::Token cur_token;
-    lexer::Token peek_token;
+    std::shared_ptr<SourceTokens> shared;
+    lexer::TokenBuffer &tokens;
+    // index of the current token in tokens; the peek token is the next
+    // one. tokens are read in place, a string or symbol is only made for
+    // a node that stores one
+    size_t cur_pos = 0;
     vector<string> errors;
-
-    // two maps for infix and prefix parse fns
-    unordered_map<lexer::TokenType, 
-        std::function<std::unique_ptr<Expression>()>> prefix_parse_fns;
-    unordered_map<lexer::TokenType, 
-        std::function<std::unique_ptr<Expression>(std::unique_ptr<Expression>)>> infix_parse_fns;
-
-    Parser(lexer::Lexer l) : l (l) {
-        next_token();
-        next_token();
-        register_prefix(lexer::TokenType::ID, std::bind(&Parser::parse_identifier, this));
-        register_prefix(lexer::TokenType::INT, std::bind(&Parser::parse_integer_literal, this));
-        register_prefix(lexer::TokenType::BANG, std::bind(&Parser::parse_prefix_expression, this));
-        register_prefix(lexer::TokenType::MINUS, std::bind(&Parser::parse_prefix_expression, this));
-        register_prefix(lexer::TokenType::TRUE, std::bind(&Parser::parse_boolean, this));
-        register_prefix(lexer::TokenType::FALSE, std::bind(&Parser::parse_boolean, this));
-        register_prefix(lexer::TokenType::LPAREN, std::bind(&Parser::parse_grouped_expression, this));
-        register_prefix(lexer::TokenType::IF, std::bind(&Parser::parse_if_expression, this));
-        register_prefix(lexer::TokenType::FUNCTION, std::bind(&Parser::parse_function_literal, this));
-
-        register_infix(lexer::TokenType::PLUS, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::MINUS, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::FSLASH, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::ASTERISK, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::EQ, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::NEQ, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::LT, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::GT, 
-            std::bind(&Parser::parse_infix_expression, this, std::placeholders::_1));
-        register_infix(lexer::TokenType::LPAREN,
-            std::bind(&Parser::parse_call_expression, this, std::placeholders::_1));
-    };
+    // holds the spans of the parse, and the nodes unless heap_nodes is set,
+    // which allocates every node on the heap
+    std::shared_ptr<AstArena> arena;
+    bool heap_nodes = false;
+    // pre-parse mode: function bodies are only brace-matched and parsed on
+    // their first call (FunctionLiteral::parse_body), so syntax errors in a
+    // body surface when it is called. off by default, which parses and
+    // validates everything up front
+    bool lazy_bodies = false;
+    // deepest nesting of parentheses, operators, call arguments and blocks
+    // before the parse gives up with an error. expressions are parsed on an
+    // explicit stack, blocks recurse, so this bounds native stack use. it
+    // also bounds the height of the tree, which the evaluators and the
+    // optimizer walk recursively: `1 + 1 + ...` only ever nests one level
+    // but is as tall as it is long
+    size_t max_nesting = 5000;
+    size_t nesting = 0;
+    // height of the last expression, statement or block parsed
+    size_t _height = 0;
+    bool _too_deep = false;
+    std::vector<ExprFrame> _frames;
+
+    Parser(lexer::Lexer l) : Parser(lexer::tokenize(l)) {}
+    Parser(lexer::TokenBuffer tokens)
+        : Parser(std::make_shared<SourceTokens>(std::string(), std::move(tokens)), 0,
+            std::make_shared<AstArena>()) {}
+    // starts at token pos of an existing stream, used for skipped bodies
+    Parser(std::shared_ptr<SourceTokens> shared, size_t pos, std::shared_ptr<AstArena> arena)
+        : shared(std::move(shared)), tokens(this->shared->tokens), cur_pos(pos),
+          arena(std::move(arena)) {}
 
     void next_token(){
-        cur_token = peek_token;
-        peek_token = l.next_token();
+        cur_pos++;
+    }
+
+    lexer::TokenType cur_type() const {
+        return tokens.type(cur_pos);
+    }
+
+    // jumps so that token pos is the current one
+    void _seek(size_t pos){
+        cur_pos = pos;
+    }
+
+    template <typename T, typename... Args>
+    NodePtr<T> _make_node(Args&&... args){
+        return make_node<T>(heap_nodes ? nullptr : arena.get(), std::forward<Args>(args)...);
+    }
+
+    // span of the current token
+    uint32_t _span(){
+        return arena->span(tokens.type(cur_pos), tokens.lexeme(cur_pos));
+    }
+
+    // symbol id of the current token, an identifier
+    uint32_t _symbol(){
+        return lexer::intern(tokens.lexeme(cur_pos));
     }
 
     bool _cur_tok_is(lexer::TokenType t);
     bool _peek_tok_is(lexer::TokenType t); 
     bool _expect_peek(lexer::TokenType t);
     void _peek_error(lexer::TokenType t);
+    std::string _location(size_t pos);
     int _peek_precedence();
     int _cur_precedence();
+    size_t _matching_brace(size_t pos);
+    void _nesting_error();
+    size_t _tree_height(size_t height);
 
     vector<string> get_errors();
 
-    std::unique_ptr<LetStatement> parse_let_statement();
-    std::unique_ptr<ReturnStatement> parse_ret_statement();
-    std::unique_ptr<ExpressionStatement> parse_expression_statement();
-    std::unique_ptr<BlockStatement> parse_block_statement();
-
-    std::unique_ptr<Program> parse_program();
-    std::unique_ptr<Statement> parse_statement();
-
-    std::unique_ptr<Expression> parse_boolean();
-    std::unique_ptr<Expression> parse_expression(int precedence);
-    std::unique_ptr<Expression> parse_grouped_expression();
-    std::unique_ptr<Expression> parse_identifier();
-    std::unique_ptr<Expression> parse_if_expression();
-    std::unique_ptr<Expression> parse_infix_expression(std::unique_ptr<Expression> left);
-    std::unique_ptr<Expression> parse_integer_literal();
-    std::unique_ptr<Expression> parse_function_literal();
-    std::unique_ptr<Expression> parse_prefix_expression();
-    std::unique_ptr<Expression> parse_call_expression(std::unique_ptr<Expression> function);
-
-    std::vector<std::unique_ptr<Expression>> parse_call_arguments();
-    std::vector<std::unique_ptr<Identifier>> parse_function_call_parameters();
-
-    void register_prefix(lexer::TokenType token_type, 
-        std::function<std::unique_ptr<Expression>()> fn);
-    void register_infix(lexer::TokenType token_type, 
-        std::function<std::unique_ptr<Expression>(std::unique_ptr<Expression>)>);
+    NodePtr<LetStatement> parse_let_statement();
+    NodePtr<ReturnStatement> parse_ret_statement();
+    NodePtr<ExpressionStatement> parse_expression_statement();
+    NodePtr<BlockStatement> parse_block_statement();
+
+    NodePtr<Program> parse_program();
+    NodePtr<Statement> parse_statement();
+
+    NodePtr<Expression> parse_boolean();
+    NodePtr<Expression> parse_expression(int precedence);
+    NodePtr<Expression> parse_identifier();
+    NodePtr<Expression> parse_if_expression();
+    NodePtr<Expression> parse_integer_literal();
+    NodePtr<Expression> parse_function_literal();
+
+    std::vector<NodePtr<Identifier>> parse_function_call_parameters();
+};
+
+// pratt parsing table, one entry per token type, built at compile time.
+// prefix/infix are NONE when the token cannot start/continue an expression
+struct ParseRule {
+    // a LEAF is parsed whole by the leaf function. the operand of an
+    // OPERATOR and the inside of a GROUP, `(`, are parsed by
+    // parse_expression on its own stack
+    enum class Prefix : uint8_t {NONE, LEAF, OPERATOR, GROUP};
+    // OPERATOR is a binary operator, CALL the `(` of a call
+    enum class Infix : uint8_t {NONE, OPERATOR, CALL};
+    Prefix prefix;
+    NodePtr<Expression> (Parser::*leaf)();
+    Infix infix;
+    int precedence;
 };
 
 void test_let_statements();
@@ -270,7 +434,11 @@ void test_integer_literal_expression();
 void test_parsing_prefix_expression();
 void test_parsing_infix_expression();
 void test_operator_precedence_parsing();
-void test_infix_expression(std::unique_ptr<Expression> exp, const std::any& expected);
+void test_infix_expression(NodePtr<Expression> exp, const std::any& expected);
 void test_if_expression();
 void test_call_expression();
-}
\ No newline at end of file
+void test_arena_teardown();
+void test_deep_nesting();
+}
+
+#endif
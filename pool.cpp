@@ -0,0 +1,354 @@
+#include "pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace pool {
+
+namespace {
+
+constexpr size_t CLASSES = MAX_SIZE / GRANULE;
+// blocks moved between a thread and the depot at a time
+constexpr uint32_t BATCH = 64;
+
+struct Block {
+    Block *next;
+};
+
+size_t class_of(size_t size){
+    return size == 0 ? 0 : (size - 1) / GRANULE;
+}
+
+size_t block_size(size_t k){
+    return (k + 1) * GRANULE;
+}
+
+std::atomic<uint32_t> counter_count{0};
+const Counter *counters[MAX_COUNTERS];
+
+struct Counts {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> frees{0};
+    std::atomic<uint64_t> bytes{0};
+};
+
+// only the owning thread writes its counts, so adding to one needs no
+// atomic read-modify-write; the atomics only keep usage() race free
+void add(std::atomic<uint64_t> &n, uint64_t by){
+    n.store(n.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+}
+
+struct Cache;
+
+// blocks given back by threads, and what the caches need to be found
+struct Depot {
+    std::mutex mutex;
+    Block *free[CLASSES] = {};
+    size_t slabs = 0;
+    Cache *caches = nullptr;
+    // counts of threads that have exited
+    Counts retired[MAX_COUNTERS];
+};
+
+// never destroyed, so threads that outlive main can still return blocks
+Depot &depot(){
+    static Depot *d = new Depot();
+    return *d;
+}
+
+struct Cache {
+    Block *free[CLASSES] = {};
+    uint32_t length[CLASSES] = {};
+    // unused rest of the slab each class carves new blocks from
+    char *bump[CLASSES] = {};
+    char *bump_end[CLASSES] = {};
+    Counts counts[MAX_COUNTERS];
+    Cache *prev = nullptr;
+    Cache *next = nullptr;
+
+    Cache(){
+        Depot &d = depot();
+        std::lock_guard lock(d.mutex);
+        next = d.caches;
+        if(next != nullptr){
+            next->prev = this;
+        }
+        d.caches = this;
+    }
+
+    // everything the thread still holds goes back to the depot
+    ~Cache(){
+        Depot &d = depot();
+        std::lock_guard lock(d.mutex);
+        for(size_t k = 0; k < CLASSES; k++){
+            size_t size = block_size(k);
+            for(; bump[k] != nullptr && bump_end[k] - bump[k] >= (ptrdiff_t)size; bump[k] += size){
+                auto b = (Block*)bump[k];
+                b->next = free[k];
+                free[k] = b;
+            }
+            while(free[k] != nullptr){
+                Block *b = free[k];
+                free[k] = b->next;
+                b->next = d.free[k];
+                d.free[k] = b;
+            }
+        }
+        for(size_t i = 0; i < MAX_COUNTERS; i++){
+            add(d.retired[i].allocations, counts[i].allocations);
+            add(d.retired[i].frees, counts[i].frees);
+            add(d.retired[i].bytes, counts[i].bytes);
+        }
+        if(prev != nullptr){
+            prev->next = next;
+        }else{
+            d.caches = next;
+        }
+        if(next != nullptr){
+            next->prev = prev;
+        }
+    }
+};
+
+thread_local Cache cache;
+
+// the thread's list of class k is empty and its slab used up: take a batch
+// from the depot, or start a new slab
+[[maybe_unused]] void *refill(Cache &c, size_t k){
+    Depot &d = depot();
+    size_t size = block_size(k);
+    {
+        std::lock_guard lock(d.mutex);
+        for(uint32_t i = 0; i < BATCH && d.free[k] != nullptr; i++){
+            Block *b = d.free[k];
+            d.free[k] = b->next;
+            b->next = c.free[k];
+            c.free[k] = b;
+            c.length[k]++;
+        }
+        if(c.free[k] == nullptr){
+            d.slabs++;
+        }
+    }
+    if(Block *b = c.free[k]){
+        c.free[k] = b->next;
+        c.length[k]--;
+        return b;
+    }
+    char *slab = (char*)::operator new(SLAB_SIZE);
+    c.bump[k] = slab + size;
+    c.bump_end[k] = slab + SLAB_SIZE;
+    return slab;
+}
+
+// the thread's list of class k is long: hand a batch to the depot
+[[maybe_unused]] void spill(Cache &c, size_t k){
+    Block *first = c.free[k], *last = first;
+    for(uint32_t i = 1; i < BATCH; i++){
+        last = last->next;
+    }
+    c.free[k] = last->next;
+    c.length[k] -= BATCH;
+    Depot &d = depot();
+    std::lock_guard lock(d.mutex);
+    last->next = d.free[k];
+    d.free[k] = first;
+}
+
+}
+
+Counter::Counter(const std::type_info &type) : type(type) {
+    id = counter_count.fetch_add(1);
+    if(id >= MAX_COUNTERS){
+        // counted together with the last type that fit
+        id = MAX_COUNTERS - 1;
+        return;
+    }
+    counters[id] = this;
+}
+
+void *allocate(size_t size, const Counter &counter){
+    Cache &c = cache;
+    Counts &n = c.counts[counter.id];
+    add(n.allocations, 1);
+    add(n.bytes, size);
+#ifdef POOL_USE_MALLOC
+    return ::operator new(size);
+#else
+    if(size > MAX_SIZE){
+        return ::operator new(size);
+    }
+    size_t k = class_of(size);
+    if(Block *b = c.free[k]){
+        c.free[k] = b->next;
+        c.length[k]--;
+        return b;
+    }
+    size_t block = block_size(k);
+    if(c.bump_end[k] - c.bump[k] >= (ptrdiff_t)block){
+        void *p = c.bump[k];
+        c.bump[k] += block;
+        return p;
+    }
+    return refill(c, k);
+#endif
+}
+
+void release(void *p, size_t size, const Counter &counter){
+    Cache &c = cache;
+    add(c.counts[counter.id].frees, 1);
+#ifdef POOL_USE_MALLOC
+    ::operator delete(p);
+#else
+    if(size > MAX_SIZE){
+        ::operator delete(p);
+        return;
+    }
+    size_t k = class_of(size);
+    auto b = (Block*)p;
+    b->next = c.free[k];
+    c.free[k] = b;
+    if(++c.length[k] > 2 * BATCH){
+        spill(c, k);
+    }
+#endif
+}
+
+std::vector<Usage> usage(){
+    std::vector<Usage> out;
+    Depot &d = depot();
+    std::lock_guard lock(d.mutex);
+    uint32_t count = std::min<uint32_t>(counter_count, MAX_COUNTERS);
+    for(uint32_t i = 0; i < count; i++){
+        Usage u;
+        int status = 0;
+        char *name = abi::__cxa_demangle(counters[i]->type.name(), nullptr, nullptr, &status);
+        u.type = status == 0 ? name : counters[i]->type.name();
+        free(name);
+        auto sum = [&](const Counts &n){
+            u.allocations += n.allocations.load(std::memory_order_relaxed);
+            u.frees += n.frees.load(std::memory_order_relaxed);
+            u.bytes += n.bytes.load(std::memory_order_relaxed);
+        };
+        sum(d.retired[i]);
+        for(Cache *c = d.caches; c != nullptr; c = c->next){
+            sum(c->counts[i]);
+        }
+        out.push_back(std::move(u));
+    }
+    return out;
+}
+
+size_t slab_bytes(){
+    Depot &d = depot();
+    std::lock_guard lock(d.mutex);
+    return d.slabs * SLAB_SIZE;
+}
+
+void print_usage(FILE *out){
+    for(auto &u : usage()){
+        if(u.allocations == 0){
+            continue;
+        }
+        fprintf(out, "pool: %s: %llu allocations, %llu live, %llu bytes\n", u.type.c_str(),
+            (unsigned long long)u.allocations, (unsigned long long)(u.allocations - u.frees),
+            (unsigned long long)u.bytes);
+    }
+    fprintf(out, "pool: %zu KB in slabs\n", slab_bytes() / 1024);
+}
+
+namespace {
+
+struct Small : Pooled<Small> {
+    char data[40];
+};
+
+struct Large : Pooled<Large> {
+    char data[MAX_SIZE + 1];
+};
+
+struct Base {
+    virtual ~Base() {}
+};
+
+struct Derived : Base, Pooled<Derived> {
+    char data[100];
+};
+
+template <typename T>
+Usage usage_of(){
+    return usage()[T::counter.id];
+}
+
+}
+
+void test_pool(){
+    int passed = 0, total = 0;
+    auto check = [&](bool ok, const char *what){
+        total++;
+        if(ok){
+            passed++;
+        }else{
+            printf("[error] %s\n", what);
+        }
+    };
+
+    std::vector<Small*> small;
+    for(int i = 0; i < 1000; i++){
+        small.push_back(new Small());
+        memset(small.back()->data, i & 0xff, sizeof(Small::data));
+    }
+    bool intact = true;
+    for(int i = 0; i < 1000; i++){
+        for(char byte : small[i]->data){
+            intact = intact && byte == (char)(i & 0xff);
+        }
+    }
+    check(intact, "blocks overlap");
+    Usage u = usage_of<Small>();
+    check(u.allocations == 1000 && u.frees == 0 && u.bytes == 1000 * sizeof(Small),
+        "small allocations not counted");
+    Small *last = small.back();
+    for(Small *p : small){
+        delete p;
+    }
+    Small *again = new Small();
+#ifndef POOL_USE_MALLOC
+    check(again == last, "freed block not reused");
+#endif
+    delete again;
+    check(usage_of<Small>().frees == 1001, "frees not counted");
+
+    delete new Large();
+    u = usage_of<Large>();
+    check(u.allocations == 1 && u.frees == 1 && u.bytes == sizeof(Large),
+        "large allocation not counted");
+
+    // freed through a base, with the size of the derived type
+    Base *base = new Derived();
+    delete base;
+    u = usage_of<Derived>();
+    check(u.allocations == 1 && u.frees == 1, "delete through a base not counted");
+
+    // made on one thread, freed on another after the first has exited
+    std::vector<Small*> moved;
+    std::thread([&](){
+        for(int i = 0; i < 500; i++){
+            moved.push_back(new Small());
+        }
+    }).join();
+    for(Small *p : moved){
+        delete p;
+    }
+    u = usage_of<Small>();
+    check(u.allocations == 1501 && u.frees == 1501, "counts of an exited thread lost");
+
+    printf("[%d/%d] test cases passed\n", passed, total);
+}
+
+}
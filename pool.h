@@ -0,0 +1,94 @@
+#ifndef POOL_H
+#define POOL_H
+
+// size-class allocator for the objects evaluation creates and drops all
+// the time: errors, functions and environments. sizes are rounded up to a
+// multiple of GRANULE, and each size class hands out blocks from 64 KB
+// slabs through a free list. every thread keeps its own free lists and
+// slab, so an allocation is a pointer pop without a lock; a thread passes
+// blocks to and from a shared depot in batches when its list runs empty or
+// grows long. slabs are never given back to the system.
+//
+// building pool.cpp with -DPOOL_USE_MALLOC sends every allocation straight
+// to the global operator new (malloc) instead, to compare the two; the
+// counters work in both builds
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <typeinfo>
+#include <vector>
+
+namespace pool {
+
+constexpr size_t GRANULE = 16;
+// anything larger goes to operator new
+constexpr size_t MAX_SIZE = 256;
+constexpr size_t SLAB_SIZE = 64 * 1024;
+// number of types with their own counters
+constexpr size_t MAX_COUNTERS = 32;
+
+// allocation counters of one type, kept per thread and summed by usage()
+struct Counter {
+    const std::type_info &type;
+    uint32_t id;
+    explicit Counter(const std::type_info &type);
+};
+
+void *allocate(size_t size, const Counter &counter);
+void release(void *p, size_t size, const Counter &counter);
+
+// base of a type T whose objects come from the pools, counted under T.
+// deleting through a base with a virtual destructor passes the size of
+// the real type to operator delete
+template <typename T>
+struct Pooled {
+    static inline Counter counter{typeid(T)};
+
+    static void *operator new(size_t size){
+        return allocate(size, counter);
+    }
+    static void operator delete(void *p, size_t size){
+        release(p, size, counter);
+    }
+};
+
+// std allocator over the pools, for the variable sized parts of pooled
+// objects, e.g. the slots of an environment. counted under Allocator<T>
+template <typename T>
+struct Allocator {
+    using value_type = T;
+    static inline Counter counter{typeid(Allocator<T>)};
+
+    Allocator() = default;
+    template <typename U>
+    Allocator(const Allocator<U> &) {}
+    T *allocate(size_t n){
+        return static_cast<T*>(pool::allocate(n * sizeof(T), counter));
+    }
+    void deallocate(T *p, size_t n){
+        release(p, n * sizeof(T), counter);
+    }
+    template <typename U>
+    bool operator==(const Allocator<U> &) const { return true; }
+};
+
+struct Usage {
+    std::string type;
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t bytes = 0;
+};
+
+// per type, summed over all threads
+std::vector<Usage> usage();
+// one line per type that was allocated, and the memory held in slabs
+void print_usage(FILE *out);
+size_t slab_bytes();
+
+void test_pool();
+
+}
+
+#endif
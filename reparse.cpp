@@ -0,0 +1,259 @@
+#include "reparse.h"
+#include "resolver.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+namespace reparse {
+
+namespace {
+
+uint64_t hash_text(std::string_view text){
+    return std::hash<std::string_view>{}(text);
+}
+
+struct Parsed {
+    std::vector<parser::NodePtr<parser::Statement>> statements;
+    std::vector<Span> spans;
+    std::vector<std::string> errors;
+    // no errors, balanced brackets and a `;` at the end, see reparse.h
+    bool clean = false;
+};
+
+// parses source[begin, end) as a run of top-level statements, the same
+// way parse_program does, with spans relative to the whole source
+Parsed parse_range(std::string_view source, size_t begin, size_t end,
+    std::shared_ptr<parser::AstArena> arena){
+    Parsed out;
+    parser::Parser p(std::make_shared<parser::SourceTokens>(std::string(),
+        lexer::tokenize_range(source, begin, end)), 0, std::move(arena));
+    const auto &tokens = p.tokens;
+    size_t last = tokens.size() - 1;
+    while(p.cur_type() != lexer::TokenType::ENDOF){
+        size_t first = p.cur_pos;
+        auto stmt = p.parse_statement();
+        if(stmt != nullptr){
+            size_t at = std::min(p.cur_pos, last);
+            size_t b = tokens.offsets[first];
+            size_t e = tokens.offsets[at] + tokens.lengths[at];
+            out.spans.push_back({b, e, hash_text(source.substr(b, e - b)),
+                tokens.type(at) == lexer::TokenType::SEMICOLON});
+            resolver::resolve(*stmt);
+            out.statements.push_back(std::move(stmt));
+        }
+        p.next_token();
+    }
+    out.errors = std::move(p.errors);
+
+    int depth = 0;
+    bool balanced = true;
+    for(size_t i = 0; i < last; i++){
+        switch(tokens.type(i)){
+            case lexer::TokenType::LPAREN:
+            case lexer::TokenType::LBRAC:
+                depth++;
+                break;
+            case lexer::TokenType::RPAREN:
+            case lexer::TokenType::RBRAC:
+                balanced = balanced && --depth >= 0;
+                break;
+            default:
+                break;
+        }
+    }
+    bool ends_closed = last == 0 || tokens.type(last - 1) == lexer::TokenType::SEMICOLON;
+    out.clean = out.errors.empty() && balanced && depth == 0 && ends_closed;
+    return out;
+}
+
+Stats full(Document &doc){
+    doc = parse(std::move(doc.source));
+    Stats stats;
+    stats.reparsed = doc.program->statements.size();
+    stats.full = true;
+    return stats;
+}
+
+}
+
+Document parse(std::string source){
+    Document doc;
+    doc.source = std::move(source);
+    auto arena = std::make_shared<parser::AstArena>();
+    Parsed all = parse_range(doc.source, 0, doc.source.size(), arena);
+    doc.program = parser::make_node<parser::Program>(nullptr);
+    doc.program->arena = std::move(arena);
+    doc.program->statements = std::move(all.statements);
+    doc.spans = std::move(all.spans);
+    doc.errors = std::move(all.errors);
+    return doc;
+}
+
+Stats apply(Document &doc, const Edit &edit){
+    size_t offset = std::min(edit.offset, doc.source.size());
+    size_t removed = std::min(edit.removed, doc.source.size() - offset);
+    if(!doc.errors.empty() || doc.reparsed_bytes > doc.source.size()){
+        doc.source.replace(offset, removed, edit.inserted);
+        return full(doc);
+    }
+
+    auto &spans = doc.spans;
+    auto &statements = doc.program->statements;
+    size_t n = spans.size();
+    // statements [0, k) end with a `;` before the edit and are kept
+    size_t k = std::partition_point(spans.begin(), spans.end(),
+        [&](const Span &s){ return s.end <= offset; }) - spans.begin();
+    while(k > 0 && !spans[k - 1].closed){
+        k--;
+    }
+    // statements [j, n) start after the edit and are kept if the window
+    // in front of them is a clean cut
+    size_t j = std::partition_point(spans.begin() + k, spans.end(),
+        [&](const Span &s){ return s.begin < offset + removed; }) - spans.begin();
+
+    size_t begin = k > 0 ? spans[k - 1].end : 0;
+    size_t old_end = j < n ? spans[j].begin : doc.source.size();
+    std::string old_text = doc.source.substr(begin, old_end - begin);
+    doc.source.replace(offset, removed, edit.inserted);
+    size_t delta = edit.inserted.size() - removed;
+
+    auto arena = doc.program->arena;
+    Parsed window = parse_range(doc.source, begin, old_end + delta, arena);
+    if(!window.clean && j < n){
+        old_text += doc.source.substr(old_end + delta);
+        j = n;
+        window = parse_range(doc.source, begin, doc.source.size(), arena);
+    }
+    if(!window.errors.empty()){
+        return full(doc);
+    }
+    doc.reparsed_bytes += (j < n ? spans[j].begin + delta : doc.source.size()) - begin;
+
+    Stats stats;
+    stats.reused = k + (n - j);
+    // a reparsed statement with the same text as one it replaces keeps
+    // the old node
+    std::unordered_multimap<uint64_t, size_t> replaced;
+    for(size_t m = k; m < j; m++){
+        replaced.emplace(spans[m].hash, m);
+    }
+    for(size_t i = 0; i < window.statements.size(); i++){
+        const Span &span = window.spans[i];
+        std::string_view text = std::string_view(doc.source).substr(span.begin,
+            span.end - span.begin);
+        auto [first, last] = replaced.equal_range(span.hash);
+        auto it = std::find_if(first, last, [&](const auto &entry){
+            const Span &old = spans[entry.second];
+            return std::string_view(old_text).substr(old.begin - begin,
+                old.end - old.begin) == text;
+        });
+        if(it == last){
+            stats.reparsed++;
+            continue;
+        }
+        window.statements[i] = std::move(statements[it->second]);
+        replaced.erase(it);
+        stats.reused++;
+    }
+
+    for(size_t m = j; m < n; m++){
+        spans[m].begin += delta;
+        spans[m].end += delta;
+    }
+    statements.erase(statements.begin() + k, statements.begin() + j);
+    statements.insert(statements.begin() + k,
+        std::make_move_iterator(window.statements.begin()),
+        std::make_move_iterator(window.statements.end()));
+    spans.erase(spans.begin() + k, spans.begin() + j);
+    spans.insert(spans.begin() + k, window.spans.begin(), window.spans.end());
+    return stats;
+}
+
+Stats update(Document &doc, std::string_view source){
+    std::string_view old = doc.source;
+    size_t prefix = std::mismatch(old.begin(), old.end(), source.begin(), source.end()).first
+        - old.begin();
+    size_t limit = std::min(old.size(), source.size()) - prefix;
+    size_t suffix = 0;
+    while(suffix < limit && old[old.size() - 1 - suffix] == source[source.size() - 1 - suffix]){
+        suffix++;
+    }
+    return apply(doc, {prefix, old.size() - prefix - suffix,
+        std::string(source.substr(prefix, source.size() - prefix - suffix))});
+}
+
+void test_reparse(){
+    std::string base =
+        "let a = 5;\n"
+        "let b = a * 2;\n"
+        "let add = fn(x, y) { x + y; };\n"
+        "let c = add(a, b);\n"
+        "if (c > 10) { c } else { 0 };\n"
+        "let d = c - 1;\n"
+        "d;\n";
+
+    struct Test {
+        std::string name;
+        std::string source;
+        // expected stats, or -1 to only compare with a plain parse
+        int reparsed;
+        int reused;
+    };
+    auto replace = [](std::string s, std::string from, std::string to){
+        return s.replace(s.find(from), from.size(), to);
+    };
+    // every source is applied to the document left by the one before
+    std::vector<Test> tests = {
+        {"edit one literal", replace(base, "a * 2", "a * 3"), 1, 6},
+        {"insert a statement", replace(replace(base, "a * 2", "a * 3"), "let add",
+            "let z = 9;\nlet add"), 1, 7},
+        {"drop a `;`", replace(base, "c - 1;", "c - 1"), -1, -1},
+        {"restore it", base, -1, -1},
+        {"swap two statements", replace(base, "let a = 5;\nlet b = a * 2;",
+            "let b = a * 2;\nlet a = 5;"), 0, 7},
+        {"syntax error", replace(base, "a * 2", "a * "), -1, -1},
+        // a document with errors is parsed in full, which also starts a
+        // fresh arena
+        {"fix it", base, -1, -1},
+        {"append", base + "d + 1", 1, 7},
+        {"edit the tail", base + "d + 2", 1, 7},
+        {"open a function", replace(base, "let c", "let f = fn() {\nlet c"), -1, -1},
+        {"close it again", base, -1, -1},
+        {"empty", "", -1, -1},
+        {"back to the start", base, -1, -1},
+    };
+
+    Document doc = parse(base);
+    int passed = 0;
+    for(auto &test : tests){
+        Stats stats = update(doc, test.source);
+        Document fresh = parse(test.source);
+        bool same_spans = doc.spans.size() == fresh.spans.size();
+        for(size_t i = 0; same_spans && i < doc.spans.size(); i++){
+            same_spans = doc.spans[i].begin == fresh.spans[i].begin &&
+                doc.spans[i].end == fresh.spans[i].end &&
+                doc.spans[i].closed == fresh.spans[i].closed;
+        }
+        // a program with errors has holes string() cannot print
+        bool same = doc.source == test.source && doc.errors == fresh.errors && same_spans &&
+            (!fresh.errors.empty() || doc.program->string() == fresh.program->string());
+        if(!same){
+            printf("[error] %s: document differs from a plain parse of %s\n",
+                test.name.c_str(), test.source.c_str());
+            continue;
+        }
+        if(test.reparsed >= 0 && (stats.full || stats.reparsed != size_t(test.reparsed) ||
+            stats.reused != size_t(test.reused))){
+            printf("[error] %s: expected %d reparsed and %d reused, got %zu and %zu%s\n",
+                test.name.c_str(), test.reparsed, test.reused, stats.reparsed,
+                stats.reused, stats.full ? " (full parse)" : "");
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, tests.size());
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef REPARSE_H
+#define REPARSE_H
+
+// incremental reparsing for hosts that keep re-submitting an edited
+// program. a Document remembers the source range and a content hash of
+// every top-level statement, so an edit only reparses the statements it
+// touches:
+//
+//   - statements that end with `;` before the edit are kept as they are
+//   - the window from there up to the first statement starting after the
+//     edit is lexed and parsed on its own; the statements after it are
+//     kept and only shifted
+//   - a reparsed statement whose text equals one it replaces keeps the
+//     old node
+//
+// the window only counts as a clean cut if it parses without errors, has
+// balanced brackets and ends with `;`, since a statement's parse depends
+// on nothing but its own tokens once the one before it ended with `;`.
+// otherwise the rest of the source is reparsed, and a program with
+// syntax errors is always parsed in full so the messages match a plain
+// parse.
+//
+// reparsed statements go into the program's arena next to the ones they
+// replace, so the document is parsed again from scratch once the bytes
+// reparsed since the last full parse exceed the size of the source
+
+#include "parser.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace reparse {
+
+// replace source[offset, offset + removed) by inserted. out of range
+// offsets are clamped to the source
+struct Edit {
+    size_t offset;
+    size_t removed;
+    std::string inserted;
+};
+
+// where a top-level statement came from
+struct Span {
+    size_t begin;
+    size_t end;
+    uint64_t hash;
+    // the statement ended with a `;`
+    bool closed;
+};
+
+struct Document {
+    std::string source;
+    parser::NodePtr<parser::Program> program;
+    // one per program->statements
+    std::vector<Span> spans;
+    std::vector<std::string> errors;
+    // bytes parsed into the arena since the last full parse
+    size_t reparsed_bytes = 0;
+};
+
+struct Stats {
+    size_t reused = 0;
+    size_t reparsed = 0;
+    bool full = false;
+};
+
+Document parse(std::string source);
+Stats apply(Document &doc, const Edit &edit);
+// for hosts that send the whole new text: the edit is the part between
+// the longest common prefix and suffix of the old and new source
+Stats update(Document &doc, std::string_view source);
+
+void test_reparse();
+
+}
+
+#endif
@@ -1,8 +1,13 @@
 #include "repl.h"
+#include "cache.h"
 #include "evaluator.h"
+#include "gc.h"
+#include "opt.h"
 #include <memory>
 #include <string>
 #include <iostream>
+#include <cstdio>
+#include <vector>
 
 using namespace std;
 
@@ -25,30 +30,129 @@ const char* MONKEY_FACE = R"(
                   __
 )";
 const string PROMPT = ">>> "; 
-void start(){
+
+void print_parser_errors(const vector<string> &errors){
+    std::cout << MONKEY_FACE << '\n';
+    std::cerr << "parser errors:" << '\n';
+    for(auto &s: errors){
+        cout << "\t" << s << '\n';
+    }
+}
+
+void start(int opt_level){
     string input;
-    auto environment = std::make_unique<object::Environment>(nullptr);
+    auto environment = object::new_environment();
     while(true){
         cout << PROMPT;
-        getline(cin, input);
+        if(!getline(cin, input)){
+            break;
+        }
         lexer::Lexer l(input);
         auto p = parser::Parser(l);
         auto program = p.parse_program();
         if(!p.errors.empty()){
-            std::cout << MONKEY_FACE << std::endl;
-            std::cerr << "parser errors:" << std::endl;
-            for(auto s: p.errors){
-                cout << "\t" << s << std::endl;
-            }
+            print_parser_errors(p.errors);
             continue;
         }
+        opt::optimize(*program, opt_level);
         // std::cout << program->string() << std::endl;
-        auto evaluated = 
-            eval::eval(std::move(program), environment);
-        if(evaluated != nullptr){
-            std::cout << evaluated->inspect() << std::endl;
+        auto evaluated = eval::eval(*program, environment);
+        if(evaluated){
+            // cin is tied to cout, so this is flushed before the next read
+            std::cout << evaluated.inspect() << '\n';
+        }
+
+    }
+}
+
+// collects output and writes it in large blocks instead of once per result
+struct OutputBuffer {
+    static constexpr size_t CAPACITY = 64 * 1024;
+    string buffer;
+
+    OutputBuffer() { buffer.reserve(CAPACITY); }
+    ~OutputBuffer() { flush(); }
+
+    void write_line(const string &line){
+        buffer += line;
+        buffer += '\n';
+        if(buffer.size() >= CAPACITY){
+            flush();
+        }
+    }
+    void flush(){
+        fwrite(buffer.data(), 1, buffer.size(), stdout);
+        fflush(stdout);
+        buffer.clear();
+    }
+};
+
+parser::NodePtr<parser::Program> parse(std::string_view source, int opt_level,
+    bool lazy_bodies){
+    lexer::Lexer l(source);
+    auto p = parser::Parser(l);
+    p.lazy_bodies = lazy_bodies;
+    auto program = p.parse_program();
+    if(!p.errors.empty()){
+        std::cerr << "parser errors:" << '\n';
+        for(auto &s: p.errors){
+            std::cerr << "\t" << s << '\n';
         }
+        return nullptr;
+    }
+    opt::optimize(*program, opt_level);
+    return program;
+}
+
+int run_program(const parser::Program &program){
+    auto environment = object::new_environment();
+    OutputBuffer out;
+    for(auto &stmt : program.statements){
+        gc::safepoint();
+        auto evaluated = eval::eval(*stmt, environment);
+        if(!evaluated){
+            continue;
+        }
+        // a top-level return ends the script, like eval_program
+        if(evaluated.returning){
+            out.write_line(evaluated.inspect());
+            return 0;
+        }
+        out.write_line(evaluated.inspect());
+        if(evaluated.is_error()){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int run_string(std::string_view source, int opt_level, bool lazy_bodies){
+    auto program = parse(source, opt_level, lazy_bodies);
+    if(program == nullptr){
+        return 1;
+    }
+    return run_program(*program);
+}
 
+int run_file(const std::string &path, int opt_level, bool use_cache, bool lazy_bodies){
+    lexer::MappedFile file(path);
+    if(!file.is_open()){
+        std::cerr << "could not open " << path << '\n';
+        return 1;
     }
+    if(!use_cache){
+        return run_string(file.view(), opt_level, lazy_bodies);
+    }
+    auto program = cache::load(path, file.view(), opt_level);
+    if(program == nullptr){
+        program = parse(file.view(), opt_level, lazy_bodies);
+        if(program == nullptr){
+            return 1;
+        }
+        // a cache that cannot be written only costs the next run a parse
+        cache::store(path, file.view(), *program, opt_level);
+    }
+    return run_program(*program);
 }
+
 } // namespace repl
\ No newline at end of file
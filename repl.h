@@ -1,9 +1,22 @@
 #ifndef REPL_H
 #define REPL_H
 
+#include <string>
+#include <string_view>
 
 namespace repl {
-void start();
+// opt_level is passed to opt::optimize for every parsed program
+void start(int opt_level = 1);
+
+// batch mode: the whole source is parsed once, then every top-level
+// statement is evaluated and its result written through one output
+// buffer. returns the process exit code
+// with use_cache the parsed program is kept in <path>c (see cache.h) and
+// reused while the script is unchanged. lazy_bodies sets
+// parser::Parser::lazy_bodies
+int run_file(const std::string &path, int opt_level = 1, bool use_cache = false,
+    bool lazy_bodies = false);
+int run_string(std::string_view source, int opt_level = 1, bool lazy_bodies = false);
 }
 
-#endif
\ No newline at end of file
+#endif
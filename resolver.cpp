@@ -0,0 +1,266 @@
+#include "resolver.h"
+#include <cstdio>
+#include <fmt/format.h>
+#include <string>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace resolver {
+
+namespace {
+
+// calls v.identifier and v.function on those nodes, and for any other
+// node v.child on each of its children (after v.let on a let). the
+// parameters and body of a function are left to v.function. node types are
+// leaves of the hierarchy, so they are told apart by typeid, most common
+// first: a failed dynamic_cast walks the bases, and this runs on every
+// node of every parse
+template <typename V>
+void visit(parser::Node *node, V &v){
+    const std::type_info &type = typeid(*node);
+    if(type == typeid(parser::Identifier)){
+        v.identifier(*static_cast<parser::Identifier*>(node));
+    }else if(type == typeid(parser::InfixExpression)){
+        auto p = static_cast<parser::InfixExpression*>(node);
+        v.child(p->left.get());
+        v.child(p->right.get());
+    }else if(type == typeid(parser::IntegerLiteral)){
+        return;
+    }else if(type == typeid(parser::CallExpression)){
+        auto p = static_cast<parser::CallExpression*>(node);
+        v.child(p->function.get());
+        for(auto &arg : p->arguments){
+            v.child(arg.get());
+        }
+    }else if(type == typeid(parser::ExpressionStatement)){
+        v.child(static_cast<parser::ExpressionStatement*>(node)->expr.get());
+    }else if(type == typeid(parser::LetStatement)){
+        auto p = static_cast<parser::LetStatement*>(node);
+        v.let(*p);
+        v.child(p->name.get());
+        v.child(p->value.get());
+    }else if(type == typeid(parser::BlockStatement)){
+        for(auto &stmt : static_cast<parser::BlockStatement*>(node)->statements){
+            v.child(stmt.get());
+        }
+    }else if(type == typeid(parser::IfExpression)){
+        auto p = static_cast<parser::IfExpression*>(node);
+        v.child(p->cond.get());
+        v.child(p->consequence.get());
+        v.child(p->alternative.get());
+    }else if(type == typeid(parser::FunctionLiteral)){
+        v.function(*static_cast<parser::FunctionLiteral*>(node));
+    }else if(type == typeid(parser::PrefixExpression)){
+        v.child(static_cast<parser::PrefixExpression*>(node)->right.get());
+    }else if(type == typeid(parser::ReturnStatement)){
+        v.child(static_cast<parser::ReturnStatement*>(node)->return_value.get());
+    }
+}
+
+void address(parser::Identifier &id, const Scope *scope){
+    uint32_t depth = 0;
+    for(; scope != nullptr; scope = scope->parent.get(), depth++){
+        int64_t slot = scope->find(id.sym);
+        if(slot >= 0){
+            id.depth = depth;
+            id.slot = slot;
+            return;
+        }
+    }
+    id.depth = depth;
+    id.slot = id.sym;
+}
+
+struct Resolver {
+    // functions found and not resolved yet, with the scope they are in
+    std::vector<std::pair<const parser::FunctionLiteral*, std::shared_ptr<const Scope>>> functions;
+    // expressions can be nested far deeper than the native stack allows
+    // (see Parser), so the walk keeps its own queue
+    std::vector<parser::Node*> queue;
+    std::vector<parser::Identifier*> identifiers;
+    // what the current walk runs in, null at top level
+    std::shared_ptr<Scope> scope;
+
+    void identifier(parser::Identifier &id){
+        identifiers.push_back(&id);
+    }
+    void function(parser::FunctionLiteral &literal){
+        functions.emplace_back(&literal, scope);
+    }
+    void let(parser::LetStatement &let){
+        if(scope != nullptr){
+            scope->declare(let.name->sym);
+        }
+    }
+    void child(parser::Node *node){
+        if(node != nullptr){
+            queue.push_back(node);
+        }
+    }
+
+    // one pass over the code under root: declares its lets in scope,
+    // queues its functions and, once every let is known, addresses its
+    // identifiers
+    void walk(parser::Node *root, std::shared_ptr<Scope> in){
+        scope = std::move(in);
+        queue.assign(1, root);
+        identifiers.clear();
+        for(size_t i = 0; i < queue.size(); i++){
+            visit(queue[i], *this);
+        }
+        for(parser::Identifier *id : identifiers){
+            address(*id, scope.get());
+        }
+        scope = nullptr;
+    }
+
+    void resolve(const parser::FunctionLiteral &literal, std::shared_ptr<const Scope> scope){
+        if(literal.body == nullptr){
+            // skipped by a lazy parse; parse_body resolves it later
+            literal.scope = std::move(scope);
+            literal.frame_size = literal.parameters.size();
+            return;
+        }
+        auto inner = std::make_shared<Scope>();
+        inner->parent = std::move(scope);
+        for(auto &param : literal.parameters){
+            param->depth = 0;
+            param->slot = inner->names.size();
+            // of two parameters with one name, find() sees the last
+            inner->names.push_back(param->sym);
+        }
+        walk(literal.body.get(), inner);
+        literal.frame_size = inner->names.size();
+        literal.scope = nullptr;
+    }
+
+    // resolves the queued functions, and the ones found in them
+    void finish(){
+        while(!functions.empty()){
+            auto [literal, in] = std::move(functions.back());
+            functions.pop_back();
+            resolve(*literal, std::move(in));
+        }
+    }
+};
+
+}
+
+void resolve(parser::Program &program){
+    Resolver resolver;
+    for(auto &stmt : program.statements){
+        resolver.walk(stmt.get(), nullptr);
+    }
+    resolver.finish();
+}
+
+void resolve(parser::Statement &statement){
+    Resolver resolver;
+    resolver.walk(&statement, nullptr);
+    resolver.finish();
+}
+
+void resolve_body(const parser::FunctionLiteral &literal){
+    Resolver resolver;
+    resolver.resolve(literal, literal.scope);
+    resolver.finish();
+}
+
+namespace {
+
+// every identifier as name:depth.slot, or name:g for a global, and every
+// function as fn/frame size, in source order. lazily skipped bodies are
+// parsed on the way
+struct Dump {
+    std::string out;
+    uint32_t functions = 0;
+
+    void add(const std::string &text){
+        out += out.empty() ? text : " " + text;
+    }
+
+    void identifier(const parser::Identifier &id){
+        if(id.depth == functions && id.slot == id.sym){
+            add(id.name() + ":g");
+        }else{
+            add(fmt::format("{}:{}.{}", id.name(), id.depth, id.slot));
+        }
+    }
+
+    void function(parser::FunctionLiteral &literal){
+        if(!literal.parse_body()){
+            add("fn?");
+            return;
+        }
+        add(fmt::format("fn/{}", literal.frame_size));
+        functions++;
+        for(auto &param : literal.parameters){
+            identifier(*param);
+        }
+        child(literal.body.get());
+        functions--;
+    }
+    void let(parser::LetStatement &){}
+    void child(parser::Node *node){
+        if(node != nullptr){
+            visit(node, *this);
+        }
+    }
+};
+
+std::string dump(const std::string &input, bool lazy){
+    lexer::Lexer l(input);
+    auto p = parser::Parser(l);
+    p.lazy_bodies = lazy;
+    auto program = p.parse_program();
+    Dump d;
+    for(auto &stmt : program->statements){
+        d.child(stmt.get());
+    }
+    return d.out;
+}
+
+}
+
+void test_resolve(){
+    struct Test {
+        std::string input;
+        std::string expected;
+    };
+
+    std::vector<Test> tests = {
+        {"let a = 1; a;", "a:g a:g"},
+        {"fn(x, y) { x + y }", "fn/2 x:0.0 y:0.1 x:0.0 y:0.1"},
+        {"fn(x) { let y = x; fn(z) { x + y + z + w } }",
+            "fn/2 x:0.0 y:0.1 x:0.0 fn/1 z:0.0 x:1.0 y:1.1 z:0.0 w:g"},
+        {"fn(x) { fn(x) { x } }", "fn/1 x:0.0 fn/1 x:0.0 x:0.0"},
+        {"fn() { if (c) { let a = 1; a } else { let b = 2; b } }",
+            "fn/2 c:g a:0.0 a:0.0 b:0.1 b:0.1"},
+        {"fn() { let y = x; let x = 1; x }", "fn/2 y:0.0 x:0.1 x:0.1 x:0.1"},
+        {"fn(x) { let x = x + 1; x }", "fn/1 x:0.0 x:0.0 x:0.0 x:0.0"},
+        {"let f = fn() { f() }", "f:g fn/0 f:g"},
+        {"fn(a) { fn(b) { fn(c) { a + b + c } } }",
+            "fn/1 a:0.0 fn/1 b:0.0 fn/1 c:0.0 a:2.0 b:1.0 c:0.0"},
+    };
+
+    int passed = 0;
+    for(auto &test : tests){
+        auto eager = dump(test.input, false);
+        auto lazy = dump(test.input, true);
+        if(eager != test.expected){
+            printf("[error] resolve %s: expected %s, got %s\n", test.input.c_str(),
+                test.expected.c_str(), eager.c_str());
+            continue;
+        }
+        if(lazy != eager){
+            printf("[error] resolve %s lazily: expected %s, got %s\n", test.input.c_str(),
+                eager.c_str(), lazy.c_str());
+            continue;
+        }
+        passed++;
+    }
+    printf("[%d/%zu] test cases passed\n", passed, tests.size());
+}
+
+}
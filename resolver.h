@@ -0,0 +1,63 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+// lexical addressing pass run right after parsing. every Identifier gets
+// the place its variable lives in: a depth, the number of environments to
+// walk out from the one it is evaluated in, and a slot in that one. every
+// FunctionLiteral gets the number of slots its call frame needs, one per
+// parameter and then one per name its body lets. blocks do not open a
+// scope, so a let inside an if belongs to the enclosing function.
+//
+// a name a function lets anywhere in its body refers to the function's own
+// slot everywhere in it; reading it before the let ran finds the slot empty
+// ("identifier not found"), even if an outer scope has the name. a name no
+// enclosing function declares is global. the outermost environment is
+// indexed by symbol id (lexer::intern), so top-level code resolves to
+// itself and programs run one after another in the same environment (the
+// repl, reparse::Document) agree on where every global is.
+//
+// Parser::parse_program resolves what it parsed. a body skipped by a lazy
+// parse keeps the scopes it was found in and is resolved by
+// FunctionLiteral::parse_body
+
+#include "parser.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace resolver {
+
+// the names one function declares, inside the functions it is nested in
+struct Scope {
+    std::shared_ptr<const Scope> parent;
+    // symbol id of each slot. a function has few names, so they are
+    // searched rather than hashed
+    std::vector<uint32_t> names;
+
+    // slot of sym, or -1
+    int64_t find(uint32_t sym) const {
+        for(size_t i = names.size(); i-- > 0;){
+            if(names[i] == sym){
+                return i;
+            }
+        }
+        return -1;
+    }
+    void declare(uint32_t sym){
+        if(find(sym) < 0){
+            names.push_back(sym);
+        }
+    }
+};
+
+void resolve(parser::Program &program);
+// one top-level statement
+void resolve(parser::Statement &statement);
+// the body of literal, once a lazy parse has filled it in
+void resolve_body(const parser::FunctionLiteral &literal);
+
+void test_resolve();
+
+}
+
+#endif
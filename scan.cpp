@@ -0,0 +1,262 @@
+#include "scan.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+namespace scan {
+
+namespace {
+
+const char* skip_whitespace_scalar(const char* p, const char* end){
+    while(p < end && is_space(*p)) p++;
+    return p;
+}
+
+const char* skip_alpha_scalar(const char* p, const char* end){
+    while(p < end && is_alpha(*p)) p++;
+    return p;
+}
+
+const char* skip_digits_scalar(const char* p, const char* end){
+    while(p < end && is_digit(*p)) p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+
+// unsigned range check on bytes: (x - lo) <= (hi - lo), via min_epu8
+inline __m128i in_range_sse2(__m128i x, char lo, char hi){
+    __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+inline __m128i space_mask_sse2(__m128i x){
+    __m128i m = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+    return _mm_or_si128(m, _mm_cmpeq_epi8(x, _mm_set1_epi8('\r')));
+}
+
+inline __m128i alpha_mask_sse2(__m128i x){
+    return in_range_sse2(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+}
+
+inline __m128i digit_mask_sse2(__m128i x){
+    return in_range_sse2(x, '0', '9');
+}
+
+// runs 16 bytes at a time while every byte is in the class, then finds the
+// first byte that is not
+template <__m128i (*Mask)(__m128i)>
+const char* skip_sse2(const char* p, const char* end,
+    const char* (*tail)(const char*, const char*)){
+    while(end - p >= 16){
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned bits = _mm_movemask_epi8(Mask(x)) ^ 0xFFFF;
+        if(bits != 0){
+            return p + __builtin_ctz(bits);
+        }
+        p += 16;
+    }
+    return tail(p, end);
+}
+
+const char* skip_whitespace_sse2(const char* p, const char* end){
+    return skip_sse2<space_mask_sse2>(p, end, skip_whitespace_scalar);
+}
+
+const char* skip_alpha_sse2(const char* p, const char* end){
+    return skip_sse2<alpha_mask_sse2>(p, end, skip_alpha_scalar);
+}
+
+const char* skip_digits_sse2(const char* p, const char* end){
+    return skip_sse2<digit_mask_sse2>(p, end, skip_digits_scalar);
+}
+
+__attribute__((target("avx2")))
+inline __m256i in_range_avx2(__m256i x, char lo, char hi){
+    __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
+}
+
+__attribute__((target("avx2")))
+inline __m256i space_mask_avx2(__m256i x){
+    __m256i m = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+    return _mm256_or_si256(m, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\r')));
+}
+
+__attribute__((target("avx2")))
+inline __m256i alpha_mask_avx2(__m256i x){
+    return in_range_avx2(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+}
+
+__attribute__((target("avx2")))
+inline __m256i digit_mask_avx2(__m256i x){
+    return in_range_avx2(x, '0', '9');
+}
+
+template <__m256i (*Mask)(__m256i)>
+__attribute__((target("avx2")))
+const char* skip_avx2(const char* p, const char* end,
+    const char* (*tail)(const char*, const char*)){
+    while(end - p >= 32){
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        unsigned bits = ~(unsigned)_mm256_movemask_epi8(Mask(x));
+        if(bits != 0){
+            return p + __builtin_ctz(bits);
+        }
+        p += 32;
+    }
+    return tail(p, end);
+}
+
+__attribute__((target("avx2")))
+const char* skip_whitespace_avx2(const char* p, const char* end){
+    return skip_avx2<space_mask_avx2>(p, end, skip_whitespace_sse2);
+}
+
+__attribute__((target("avx2")))
+const char* skip_alpha_avx2(const char* p, const char* end){
+    return skip_avx2<alpha_mask_avx2>(p, end, skip_alpha_sse2);
+}
+
+__attribute__((target("avx2")))
+const char* skip_digits_avx2(const char* p, const char* end){
+    return skip_avx2<digit_mask_avx2>(p, end, skip_digits_sse2);
+}
+
+#endif
+
+Kernels select_kernels(){
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+        return {"avx2", skip_whitespace_avx2, skip_alpha_avx2, skip_digits_avx2};
+    }
+    if(__builtin_cpu_supports("sse2")){
+        return {"sse2", skip_whitespace_sse2, skip_alpha_sse2, skip_digits_sse2};
+    }
+#endif
+    return {"scalar", skip_whitespace_scalar, skip_alpha_scalar, skip_digits_scalar};
+}
+
+// converts 8 ascii digits (first digit in the lowest byte) in three
+// multiply steps instead of eight
+inline uint64_t parse_eight_digits(const char* p){
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    chunk -= 0x3030303030303030ULL;
+    chunk = (chunk * 10 + (chunk >> 8)) & 0x00FF00FF00FF00FFULL;
+    chunk = (chunk * 100 + (chunk >> 16)) & 0x0000FFFF0000FFFFULL;
+    chunk = (chunk * 10000 + (chunk >> 32)) & 0x00000000FFFFFFFFULL;
+    return chunk;
+}
+
+}
+
+const Kernels kernels = select_kernels();
+
+const char* kernel_name(){
+    return kernels.name;
+}
+
+bool parse_int(std::string_view digits, int64_t &out){
+    const char* p = digits.data();
+    const char* end = p + digits.size();
+    // skip leading zeros so the length check below is exact
+    while(end - p > 1 && *p == '0') p++;
+    // INT64_MAX has 19 digits
+    if(end - p > 19){
+        return false;
+    }
+    uint64_t value = 0;
+    if(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__){
+        while(end - p >= 8){
+            value = value * 100000000ULL + parse_eight_digits(p);
+            p += 8;
+        }
+    }
+    while(p < end){
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    if(value > (uint64_t)INT64_MAX){
+        return false;
+    }
+    out = (int64_t)value;
+    return true;
+}
+
+void test_scan(){
+    printf("Test case #1\n");
+    struct Test {
+        std::string input;
+        const char* (*skip)(const char*, const char*);
+        size_t expected;
+    };
+    std::string spaces(70, ' ');
+    std::string letters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    std::vector<Test> tests = {
+        {"", skip_whitespace, 0},
+        {" \t\r\n x", skip_whitespace, 5},
+        {spaces + "\n\tx", skip_whitespace, 72},
+        {spaces, skip_whitespace, 70},
+        {"foo(", skip_alpha, 3},
+        {letters + letters + "1", skip_alpha, 104},
+        {letters + "[", skip_alpha, 52},
+        {letters + "@", skip_alpha, 52},
+        {"0123456789012345678901234567890123;", skip_digits, 34},
+        {"12/", skip_digits, 2},
+    };
+    unsigned long correct_count = 0;
+    for(int i=0; i<tests.size(); i++){
+        const char* begin = tests[i].input.data();
+        const char* end = begin + tests[i].input.size();
+        size_t got = tests[i].skip(begin, end) - begin;
+        if(got != tests[i].expected){
+            printf("[error] scan #%d (%s): expected %ld, got %ld\n", i, kernel_name(),
+                tests[i].expected, got);
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, tests.size());
+
+    printf("Test case #2\n");
+    struct IntTest {
+        std::string input;
+        bool ok;
+        int64_t expected;
+    };
+    std::vector<IntTest> int_tests = {
+        {"0", true, 0},
+        {"7", true, 7},
+        {"12345678", true, 12345678},
+        {"1234567890123", true, 1234567890123},
+        {"0000000000000000000042", true, 42},
+        {"9223372036854775807", true, INT64_MAX},
+        {"9223372036854775808", false, 0},
+        {"99999999999999999999", false, 0},
+    };
+    correct_count = 0;
+    for(int i=0; i<int_tests.size(); i++){
+        int64_t got = 0;
+        bool ok = parse_int(int_tests[i].input, got);
+        if(ok != int_tests[i].ok || (ok && got != int_tests[i].expected)){
+            printf("[error] parse_int(%s) mismatch, got %ld\n", int_tests[i].input.c_str(), got);
+        }else{
+            correct_count++;
+        }
+    }
+    printf("[%ld/%ld] test cases passed\n", correct_count, int_tests.size());
+}
+
+}
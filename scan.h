@@ -0,0 +1,69 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstdint>
+#include <string_view>
+
+// byte-run scanners used by the lexer. each one returns the first byte in
+// [p, end) that is not part of the run, or end. SSE2/AVX2 versions are
+// picked at startup when the cpu has them, otherwise a scalar loop is used.
+namespace scan {
+
+inline bool is_space(unsigned char c){
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline bool is_alpha(unsigned char c){
+    return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+inline bool is_digit(unsigned char c){
+    return (unsigned char)(c - '0') < 10;
+}
+
+using SkipFn = const char* (*)(const char*, const char*);
+
+struct Kernels {
+    const char* name;
+    SkipFn skip_whitespace;
+    SkipFn skip_alpha;
+    SkipFn skip_digits;
+};
+
+extern const Kernels kernels;
+
+// most runs in real scripts are a few bytes long, so the first 16 bytes
+// are checked inline and only longer runs are handed to the vector kernel
+template <bool (*In)(unsigned char)>
+inline const char* skip_short(const char* p, const char* end, SkipFn kernel){
+    const char* stop = (end - p > 16) ? p + 16 : end;
+    while(p < stop && In(*p)) p++;
+    if(p < stop || p == end){
+        return p;
+    }
+    return kernel(p, end);
+}
+
+inline const char* skip_whitespace(const char* p, const char* end){
+    return skip_short<is_space>(p, end, kernels.skip_whitespace);
+}
+
+inline const char* skip_alpha(const char* p, const char* end){
+    return skip_short<is_alpha>(p, end, kernels.skip_alpha);
+}
+
+inline const char* skip_digits(const char* p, const char* end){
+    return skip_short<is_digit>(p, end, kernels.skip_digits);
+}
+
+// digits must be a non-empty run of ascii digits. returns false if the
+// value does not fit in an int64_t
+bool parse_int(std::string_view digits, int64_t &out);
+
+// name of the kernel set in use: "avx2", "sse2" or "scalar"
+const char* kernel_name();
+
+void test_scan();
+}
+
+#endif